@@ -9,17 +9,24 @@ parser.add_argument('files', metavar='files', nargs='+', help='list of glsl file
 parser.add_argument('--output', action='store', dest='output', help='output file')
 parser.add_argument('--compiler', action='store', dest='compiler', help='location of spirv compiler')
 parser.add_argument('--vulkan_version', action='store', dest='version', help='vulkan version')
+parser.add_argument('--variant_name', action='store', dest='variant_name', default='', help='suffix of the variant binaries')
+parser.add_argument('--variant_define', action='append', dest='variant_defines', default=[], help='preprocessor define of the variant')
+parser.add_argument('--variant_files', metavar='variant_files', nargs='*', default=[], help='list of glsl files also compiled as a variant')
 
 args = parser.parse_args()
 
 # create temp dir
 dirpath = tempfile.mkdtemp()
 
-def genCArray(file):
-  basename = ntpath.basename(file).replace('.', '_')
+def genName(file, variant):
+  name, ext = ntpath.basename(file).split('.')
+  return name + variant + '_' + ext
+
+def genCArray(file, variant = '', defines = []):
+  basename = genName(file, variant)
   temp_file = dirpath + '/' + basename + '.txt'
   try:
-    subprocess.check_output([args.compiler,'--target-env', 'vulkan' + args.version, '-V',file,'-x','-o',temp_file]).decode('utf-8')
+    subprocess.check_output([args.compiler,'--target-env', 'vulkan' + args.version, '-V'] + ['-D' + define for define in defines] + [file,'-x','-o',temp_file]).decode('utf-8')
   except subprocess.CalledProcessError as e:
     print(e.output)
   content = None
@@ -29,8 +36,8 @@ def genCArray(file):
   spirv = 'Vortex2D::Renderer::SpirvBinary ' + basename + '(_' + basename + ');\n'
   return array + spirv
 
-def genCArrayDef(file):
-  basename = ntpath.basename(file).replace('.', '_')
+def genCArrayDef(file, variant = ''):
+  basename = genName(file, variant)
   return 'extern Vortex2D::Renderer::SpirvBinary ' + basename + ';\n'
 
 output = ntpath.basename(args.output)
@@ -55,6 +62,9 @@ namespace SPIRV
   for file in args.files:
     f.write(genCArrayDef(file))
 
+  for file in args.variant_files:
+    f.write(genCArrayDef(file, args.variant_name))
+
   f.write('''
 }
 }
@@ -80,6 +90,9 @@ namespace SPIRV
   for file in args.files:
     f.write(genCArray(file))
 
+  for file in args.variant_files:
+    f.write(genCArray(file, args.variant_name, args.variant_defines))
+
   f.write('''
 }
 }
@@ -34,9 +34,15 @@ TEST(AdvectionTests, AdvectVelocity_Simple)
     Advection advection(*device, size, 0.01f, velocity);
     advection.AdvectVelocity();
 
+    // The advected velocity is in the output field until resolved
+    EXPECT_EQ(1, velocity.GetParity());
+    velocity.Resolve();
+    EXPECT_EQ(0, velocity.GetParity());
+
     device->Queue().waitIdle();
 
-    CheckVelocity(*device, size, velocity, sim, 1e-5f);
+    // The velocity is sampled with hardware filtering, which has a lower precision
+    CheckVelocity(*device, size, velocity, sim, 1e-4f);
 }
 
 TEST(AdvectionTests, AdvectVelocity_Complex)
@@ -59,10 +65,12 @@ TEST(AdvectionTests, AdvectVelocity_Complex)
 
     Advection advection(*device, size, 0.01f, velocity);
     advection.AdvectVelocity();
+    velocity.Resolve();
 
     device->Queue().waitIdle();
 
-    CheckVelocity(*device, size, velocity, sim, 1e-5f);
+    // The velocity is sampled with hardware filtering, which has a lower precision
+    CheckVelocity(*device, size, velocity, sim, 1e-4f);
 }
 
 TEST(AdvectionTests, Advect)
@@ -113,6 +121,183 @@ TEST(AdvectionTests, Advect)
     ASSERT_EQ(128, pixels[pos.x + size.x * pos.y].x);
 }
 
+TEST(AdvectionTests, AdvectHighOrder)
+{
+    glm::ivec2 size(10);
+
+    glm::vec2 vel(3.0f, 1.0f);
+
+    Texture velocityInput(*device, size.x, size.y, vk::Format::eR32G32Sfloat, VMA_MEMORY_USAGE_CPU_ONLY);
+    std::vector<glm::vec2> velocityData(size.x * size.y, vel / glm::vec2(size));
+    velocityInput.CopyFrom(velocityData);
+
+    for (auto method: {Advection::Method::MacCormack, Advection::Method::BFECC})
+    {
+        glm::ivec2 pos(3, 4);
+
+        Velocity velocity(*device, size);
+        ExecuteCommand(*device, [&](vk::CommandBuffer commandBuffer)
+        {
+            velocity.CopyFrom(commandBuffer, velocityInput);
+        });
+
+        Texture fieldInput(*device, size.x, size.y, vk::Format::eB8G8R8A8Unorm, VMA_MEMORY_USAGE_CPU_ONLY);
+        Density field(*device, size, vk::Format::eB8G8R8A8Unorm);
+
+        std::vector<glm::u8vec4> fieldData(size.x * size.y);
+        fieldData[pos.x + size.x * pos.y].x = 128;
+        fieldInput.CopyFrom(fieldData);
+
+        ExecuteCommand(*device, [&](vk::CommandBuffer commandBuffer)
+        {
+            field.CopyFrom(commandBuffer, fieldInput);
+        });
+
+        // A whole cell displacement is exact, so the error correction must not change it
+        Advection advection(*device, size, 1.0f, velocity, method);
+        advection.AdvectBind(field);
+        advection.Advect();
+        advection.AdvectVelocity();
+        velocity.Resolve();
+
+        device->Handle().waitIdle();
+
+        ExecuteCommand(*device, [&](vk::CommandBuffer commandBuffer)
+        {
+            fieldInput.CopyFrom(commandBuffer, field);
+            velocityInput.CopyFrom(commandBuffer, velocity);
+        });
+
+        std::vector<glm::u8vec4> pixels(fieldInput.GetWidth() * fieldInput.GetHeight());
+        fieldInput.CopyTo(pixels);
+
+        pos += glm::ivec2(vel);
+        EXPECT_EQ(128, pixels[pos.x + size.x * pos.y].x);
+
+        // A constant velocity stays constant, away from the boundaries
+        std::vector<glm::vec2> velocityPixels(size.x * size.y);
+        velocityInput.CopyTo(velocityPixels);
+        for (int i = 4; i < size.x - 2; i++)
+        {
+            for (int j = 2; j < size.y - 2; j++)
+            {
+                EXPECT_NEAR(vel.x / size.x, velocityPixels[i + j * size.x].x, 1e-5f) << "Mismatch at " << i << "," << j;
+                EXPECT_NEAR(vel.y / size.y, velocityPixels[i + j * size.x].y, 1e-5f) << "Mismatch at " << i << "," << j;
+            }
+        }
+    }
+}
+
+TEST(AdvectionTests, AdvectMultipleFields)
+{
+    glm::ivec2 size(10);
+
+    glm::vec2 vel(3.0f, 1.0f);
+    glm::ivec2 pos(3, 4);
+
+    Texture velocityInput(*device, size.x, size.y, vk::Format::eR32G32Sfloat, VMA_MEMORY_USAGE_CPU_ONLY);
+    Velocity velocity(*device, size);
+
+    std::vector<glm::vec2> velocityData(size.x * size.y, vel / glm::vec2(size));
+    velocityInput.CopyFrom(velocityData);
+
+    Texture dyeInput(*device, size.x, size.y, vk::Format::eB8G8R8A8Unorm, VMA_MEMORY_USAGE_CPU_ONLY);
+    Density dye(*device, size, vk::Format::eB8G8R8A8Unorm);
+
+    std::vector<glm::u8vec4> dyeData(size.x * size.y);
+    dyeData[pos.x + size.x * pos.y].x = 128;
+    dyeInput.CopyFrom(dyeData);
+
+    Texture temperatureInput(*device, size.x, size.y, vk::Format::eR32Sfloat, VMA_MEMORY_USAGE_CPU_ONLY);
+    Density temperature(*device, size, vk::Format::eR32Sfloat);
+
+    std::vector<float> temperatureData(size.x * size.y, 0.0f);
+    temperatureData[pos.x + size.x * pos.y] = 2.5f;
+    temperatureInput.CopyFrom(temperatureData);
+
+    ExecuteCommand(*device, [&](vk::CommandBuffer commandBuffer)
+    {
+        velocity.CopyFrom(commandBuffer, velocityInput);
+        dye.CopyFrom(commandBuffer, dyeInput);
+        temperature.CopyFrom(commandBuffer, temperatureInput);
+    });
+
+    Advection advection(*device, size, 1.0f, velocity);
+    advection.AdvectBind({dye, temperature});
+    advection.Advect();
+
+    device->Handle().waitIdle();
+
+    ExecuteCommand(*device, [&](vk::CommandBuffer commandBuffer)
+    {
+        dyeInput.CopyFrom(commandBuffer, dye);
+        temperatureInput.CopyFrom(commandBuffer, temperature);
+    });
+
+    dyeInput.CopyTo(dyeData);
+    temperatureInput.CopyTo(temperatureData);
+
+    pos += glm::ivec2(vel);
+    EXPECT_EQ(128, dyeData[pos.x + size.x * pos.y].x);
+    EXPECT_FLOAT_EQ(2.5f, temperatureData[pos.x + size.x * pos.y]);
+}
+
+TEST(AdvectionTests, AdvectBatchedFields)
+{
+    glm::ivec2 size(10);
+
+    glm::vec2 vel(2.0f, 1.0f);
+
+    Texture velocityInput(*device, size.x, size.y, vk::Format::eR32G32Sfloat, VMA_MEMORY_USAGE_CPU_ONLY);
+    Velocity velocity(*device, size);
+
+    std::vector<glm::vec2> velocityData(size.x * size.y, vel / glm::vec2(size));
+    velocityInput.CopyFrom(velocityData);
+
+    ExecuteCommand(*device, [&](vk::CommandBuffer commandBuffer)
+    {
+        velocity.CopyFrom(commandBuffer, velocityInput);
+    });
+
+    // More fields than a batch holds
+    const int numFields = 5;
+    std::vector<std::unique_ptr<Density>> fields;
+    Texture fieldInput(*device, size.x, size.y, vk::Format::eR32Sfloat, VMA_MEMORY_USAGE_CPU_ONLY);
+    for (int i = 0; i < numFields; i++)
+    {
+        fields.push_back(std::make_unique<Density>(*device, size, vk::Format::eR32Sfloat));
+
+        std::vector<float> fieldData(size.x * size.y, 0.0f);
+        fieldData[1 + i + size.x * 2] = 1.0f + i;
+        fieldInput.CopyFrom(fieldData);
+
+        ExecuteCommand(*device, [&](vk::CommandBuffer commandBuffer)
+        {
+            fields.back()->CopyFrom(commandBuffer, fieldInput);
+        });
+    }
+
+    Advection advection(*device, size, 1.0f, velocity);
+    advection.AdvectBind({*fields[0], *fields[1], *fields[2], *fields[3], *fields[4]});
+    advection.Advect();
+
+    device->Handle().waitIdle();
+
+    for (int i = 0; i < numFields; i++)
+    {
+        ExecuteCommand(*device, [&](vk::CommandBuffer commandBuffer)
+        {
+            fieldInput.CopyFrom(commandBuffer, *fields[i]);
+        });
+
+        std::vector<float> fieldData(size.x * size.y);
+        fieldInput.CopyTo(fieldData);
+
+        glm::ivec2 pos = glm::ivec2(1 + i, 2) + glm::ivec2(vel);
+        EXPECT_FLOAT_EQ(1.0f + i, fieldData[pos.x + size.x * pos.y]);
+    }
+}
+
 TEST(AdvectionTests, ParticleAdvect)
 {
     glm::ivec2 size(50);
@@ -126,21 +311,19 @@ TEST(AdvectionTests, ParticleAdvect)
     sim.advance(0.01f);
 
     // setup particles
-    Buffer<Particle> particles(*device, 8 * size.x * size.y, VMA_MEMORY_USAGE_CPU_ONLY);
+    Particles particles(*device, 8 * size.x * size.y, false, false, false, VMA_MEMORY_USAGE_CPU_ONLY);
     IndirectBuffer<DispatchParams> dispatchParams(*device, VMA_MEMORY_USAGE_CPU_ONLY);
 
     DispatchParams params(static_cast<int32_t>(sim.particles.size()));
     CopyFrom(dispatchParams, params);
 
-    std::vector<Particle> particlesData;
+    std::vector<glm::vec2> particlesData;
     for (auto& p: sim.particles)
     {
-        Particle particle;
-        particle.Position = glm::vec2(p[0] * size.x, p[1] * size.x);
-        particlesData.push_back(particle);
+        particlesData.push_back(glm::vec2(p[0] * size.x, p[1] * size.x));
     }
     particlesData.resize(8*size.x*size.y);
-    CopyFrom(particles, particlesData);
+    CopyFrom(particles.Position, particlesData);
 
     // setup velocities
     Velocity velocity(*device, size);
@@ -160,15 +343,15 @@ TEST(AdvectionTests, ParticleAdvect)
     // test
     sim.advect_particles(0.01f);
 
-    std::vector<Particle> outParticlesData(size.x*size.y*8);
-    CopyTo(particles, outParticlesData);
+    std::vector<glm::vec2> outParticlesData(size.x*size.y*8);
+    CopyTo(particles.Position, outParticlesData);
 
     for (std::size_t i = 0; i < sim.particles.size(); i++)
     {
         glm::vec2 pos(sim.particles[i][0] * size.x, sim.particles[i][1] * size.x);
 
-        EXPECT_NEAR(pos.x, outParticlesData[i].Position.x, 1e-5f);
-        EXPECT_NEAR(pos.y, outParticlesData[i].Position.y, 1e-5f);
+        EXPECT_NEAR(pos.x, outParticlesData[i].x, 1e-4f);
+        EXPECT_NEAR(pos.y, outParticlesData[i].y, 1e-4f);
     }
 }
 
@@ -191,21 +374,19 @@ TEST(AdvectionTests, ParticleProject)
     sim.add_particle(bottomRight);
 
     // setup particles
-    Buffer<Particle> particles(*device, 8*size.x*size.y, VMA_MEMORY_USAGE_CPU_ONLY);
+    Particles particles(*device, 8*size.x*size.y, false, false, false, VMA_MEMORY_USAGE_CPU_ONLY);
     IndirectBuffer<DispatchParams> dispatchParams(*device, VMA_MEMORY_USAGE_CPU_ONLY);
 
     DispatchParams params(static_cast<int32_t>(sim.particles.size()));
     CopyFrom(dispatchParams, params);
 
-    std::vector<Particle> particlesData;
+    std::vector<glm::vec2> particlesData;
     for (auto& p: sim.particles)
     {
-        Particle particle;
-        particle.Position = glm::vec2(p[0] * size.x, p[1] * size.x);
-        particlesData.push_back(particle);
+        particlesData.push_back(glm::vec2(p[0] * size.x, p[1] * size.x));
     }
     particlesData.resize(8*size.x*size.y);
-    CopyFrom(particles, particlesData);
+    CopyFrom(particles.Position, particlesData);
 
     // setup velocities
     Velocity velocity(*device, size);
@@ -223,14 +404,14 @@ TEST(AdvectionTests, ParticleProject)
     // test
     sim.advect_particles(0.01f);
 
-    std::vector<Particle> outParticlesData(size.x*size.y*8);
-    CopyTo(particles, outParticlesData);
+    std::vector<glm::vec2> outParticlesData(size.x*size.y*8);
+    CopyTo(particles.Position, outParticlesData);
 
     for (std::size_t i = 0; i < sim.particles.size(); i++)
     {
         glm::vec2 pos(sim.particles[i][0] * size.x, sim.particles[i][1] * size.x);
 
-        EXPECT_NEAR(pos.x, outParticlesData[i].Position.x, 1e-5f);
-        EXPECT_NEAR(pos.y, outParticlesData[i].Position.y, 1e-5f);
+        EXPECT_NEAR(pos.x, outParticlesData[i].x, 1e-4f);
+        EXPECT_NEAR(pos.y, outParticlesData[i].y, 1e-4f);
     }
 }
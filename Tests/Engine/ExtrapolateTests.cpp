@@ -77,6 +77,81 @@ TEST(ExtrapolateTest, Extrapolate)
     CheckValid(size, sim, valid);
 }
 
+TEST(ExtrapolateTest, ExtrapolateClosestPoint)
+{
+    glm::ivec2 size(50);
+
+    FluidSim sim;
+    sim.initialize(1.0f, size.x, size.y);
+    sim.set_boundary(complex_boundary_phi);
+
+    AddParticles(size, sim, complex_boundary_phi);
+
+    sim.add_force(0.01f);
+    sim.apply_projection(0.01f);
+    sim.compute_phi();
+
+    // Constant velocity where valid, so any extrapolated value must be the same
+    const glm::vec2 value(1.0f, 2.0f);
+    for (int i = 0; i < size.x; i++)
+    {
+        for (int j = 0; j < size.y; j++)
+        {
+            sim.u(i, j) = sim.u_valid(i, j) ? value.x : 0.0f;
+            sim.v(i, j) = sim.v_valid(i, j) ? value.y : 0.0f;
+        }
+    }
+
+    Buffer<glm::ivec2> valid(*device, size.x*size.y, VMA_MEMORY_USAGE_CPU_ONLY);
+    SetValid(size, sim, valid);
+
+    Velocity velocity(*device, size);
+    SetVelocity(*device, size, velocity, sim);
+
+    Texture liquidPhi(*device, size.x, size.y, vk::Format::eR32Sfloat);
+    SetLiquidPhi(*device, size, liquidPhi, sim, (float)size.x);
+
+    Extrapolation extrapolation(*device, size, valid, velocity);
+    extrapolation.LiquidPhiBind(liquidPhi);
+    extrapolation.SetMethod(Extrapolation::Method::ClosestPoint, 3.0f);
+    extrapolation.Extrapolate();
+
+    device->Queue().waitIdle();
+
+    Texture output(*device, size.x, size.y, vk::Format::eR32G32Sfloat, VMA_MEMORY_USAGE_CPU_ONLY);
+    ExecuteCommand(*device, [&](vk::CommandBuffer commandBuffer)
+    {
+        output.CopyFrom(commandBuffer, velocity);
+    });
+
+    std::vector<glm::vec2> pixels(size.x * size.y);
+    output.CopyTo(pixels);
+
+    std::vector<glm::ivec2> validData(size.x * size.y);
+    CopyTo(valid, validData);
+
+    int extrapolated = 0;
+    for (int i = 1; i < size.x - 1; i++)
+    {
+        for (int j = 1; j < size.y - 1; j++)
+        {
+            std::size_t index = i + j * size.x;
+            auto uv = pixels[index];
+
+            if (sim.u_valid(i, j)) EXPECT_EQ(1, validData[index].x) << "Mismatch at " << i << "," << j;
+            if (sim.v_valid(i, j)) EXPECT_EQ(1, validData[index].y) << "Mismatch at " << i << "," << j;
+
+            if (validData[index].x) EXPECT_NEAR(value.x, uv.x, 1e-5f) << "Mismatch at " << i << "," << j;
+            if (validData[index].y) EXPECT_NEAR(value.y, uv.y, 1e-5f) << "Mismatch at " << i << "," << j;
+
+            if (validData[index].x && !sim.u_valid(i, j)) extrapolated++;
+            if (validData[index].y && !sim.v_valid(i, j)) extrapolated++;
+        }
+    }
+
+    EXPECT_GT(extrapolated, 0);
+}
+
 TEST(ExtrapolateTest, Constrain)
 {
     // NOTE Cannot use higher size because of weird float conversions in FluidSim
@@ -107,8 +182,75 @@ TEST(ExtrapolateTest, Constrain)
     Extrapolation extrapolation(*device, size, valid, velocity);
     extrapolation.ConstrainBind(solidPhi);
     extrapolation.ConstrainVelocity();
+    velocity.Resolve();
 
     device->Queue().waitIdle();
 
     CheckVelocity(*device, size, velocity, sim, 1e-5f);
 }
+
+TEST(ExtrapolateTest, ExtrapolateConstrain)
+{
+    glm::ivec2 size(20);
+
+    FluidSim sim;
+    sim.initialize(1.0f, size.x, size.y);
+    sim.set_boundary(complex_boundary_phi);
+
+    AddParticles(size, sim, complex_boundary_phi);
+
+    sim.add_force(0.01f);
+    sim.apply_projection(0.01f);
+
+    Texture solidPhi(*device, size.x, size.y, vk::Format::eR32Sfloat);
+    SetSolidPhi(*device, size, solidPhi, sim, (float)size.x);
+
+    Buffer<glm::ivec2> valid(*device, size.x*size.y, VMA_MEMORY_USAGE_CPU_ONLY);
+    SetValid(size, sim, valid);
+    Buffer<glm::ivec2> fusedValid(*device, size.x*size.y, VMA_MEMORY_USAGE_CPU_ONLY);
+    SetValid(size, sim, fusedValid);
+
+    Velocity velocity(*device, size);
+    SetVelocity(*device, size, velocity, sim);
+    Velocity fusedVelocity(*device, size);
+    SetVelocity(*device, size, fusedVelocity, sim);
+
+    Extrapolation extrapolation(*device, size, valid, velocity, 10);
+    extrapolation.ConstrainBind(solidPhi);
+    extrapolation.Extrapolate();
+    extrapolation.ConstrainVelocity();
+    velocity.Resolve();
+
+    Extrapolation fusedExtrapolation(*device, size, fusedValid, fusedVelocity, 10);
+    fusedExtrapolation.ConstrainBind(solidPhi);
+    fusedExtrapolation.ExtrapolateConstrain();
+
+    device->Queue().waitIdle();
+
+    Texture output(*device, size.x, size.y, vk::Format::eR32G32Sfloat, VMA_MEMORY_USAGE_CPU_ONLY);
+    Texture fusedOutput(*device, size.x, size.y, vk::Format::eR32G32Sfloat, VMA_MEMORY_USAGE_CPU_ONLY);
+    ExecuteCommand(*device, [&](vk::CommandBuffer commandBuffer)
+    {
+        output.CopyFrom(commandBuffer, velocity);
+        fusedOutput.CopyFrom(commandBuffer, fusedVelocity);
+    });
+
+    std::vector<glm::vec2> pixels(size.x * size.y), fusedPixels(size.x * size.y);
+    output.CopyTo(pixels);
+    fusedOutput.CopyTo(fusedPixels);
+
+    std::vector<glm::ivec2> validData(size.x * size.y), fusedValidData(size.x * size.y);
+    CopyTo(valid, validData);
+    CopyTo(fusedValid, fusedValidData);
+
+    for (int i = 0; i < size.x; i++)
+    {
+        for (int j = 0; j < size.y; j++)
+        {
+            std::size_t index = i + j * size.x;
+            EXPECT_NEAR(pixels[index].x, fusedPixels[index].x, 1e-5f) << "Mismatch at " << i << "," << j;
+            EXPECT_NEAR(pixels[index].y, fusedPixels[index].y, 1e-5f) << "Mismatch at " << i << "," << j;
+            EXPECT_EQ(validData[index], fusedValidData[index]) << "Mismatch at " << i << "," << j;
+        }
+    }
+}
@@ -115,6 +115,153 @@ TEST(LevelSetTests, ComplexCircles)
     CheckDifference(outTexture, complex_boundary_phi, 1.0f);
 }
 
+TEST(LevelSetTests, SimpleCircleJumpFlooding)
+{
+    glm::ivec2 size(50);
+
+    LevelSet levelSet(*device, size, 0, LevelSet::RedistanceMethod::JumpFlooding);
+    Texture outTexture(*device, size.x, size.y, vk::Format::eR32Sfloat, VMA_MEMORY_USAGE_CPU_ONLY);
+
+    Ellipse circle(*device, glm::vec2{rad0} * glm::vec2(size));
+    circle.Position = glm::vec2(c0[0], c0[1]) * glm::vec2(size) - glm::vec2(0.5f);
+    circle.Colour = glm::vec4(0.5f);
+
+    Clear clear(glm::vec4(-0.5f));
+
+    levelSet.Record({clear, circle}).Submit();
+    levelSet.Reinitialise();
+
+    device->Handle().waitIdle();
+
+    ExecuteCommand(*device, [&](vk::CommandBuffer commandBuffer)
+    {
+       outTexture.CopyFrom(commandBuffer, levelSet);
+    });
+
+    CheckDifference(outTexture, boundary_phi, 1.0f);
+}
+
+TEST(LevelSetTests, ComplexCirclesJumpFlooding)
+{
+    glm::ivec2 size(50);
+
+    LevelSet levelSet(*device, size, 0, LevelSet::RedistanceMethod::JumpFlooding);
+    Texture outTexture(*device, size.x, size.y, vk::Format::eR32Sfloat, VMA_MEMORY_USAGE_CPU_ONLY);
+
+    Ellipse circle0(*device, glm::vec2{rad0} * glm::vec2(size));
+    Ellipse circle1(*device, glm::vec2{rad1} * glm::vec2(size));
+    Ellipse circle2(*device, glm::vec2{rad2} * glm::vec2(size));
+    Ellipse circle3(*device, glm::vec2{rad3} * glm::vec2(size));
+
+    Clear clear(glm::vec4(-1.0f));
+
+    circle0.Position = glm::vec2(c0[0], c0[1]) * glm::vec2(size) - glm::vec2(0.5f);
+    circle1.Position = glm::vec2(c1[0], c1[1]) * glm::vec2(size) - glm::vec2(0.5f);
+    circle2.Position = glm::vec2(c2[0], c2[1]) * glm::vec2(size) - glm::vec2(0.5f);
+    circle3.Position = glm::vec2(c3[0], c3[1]) * glm::vec2(size) - glm::vec2(0.5f);
+
+    circle0.Colour = glm::vec4(1.0f);
+    circle1.Colour = glm::vec4(-1.0f);
+    circle2.Colour = glm::vec4(-1.0f);
+    circle3.Colour = glm::vec4(-1.0f);
+
+    levelSet.Record({clear, circle0, circle1, circle2, circle3}).Submit();
+    levelSet.Reinitialise();
+
+    device->Handle().waitIdle();
+
+    ExecuteCommand(*device, [&](vk::CommandBuffer commandBuffer)
+    {
+        outTexture.CopyFrom(commandBuffer, levelSet);
+    });
+
+    CheckDifference(outTexture, complex_boundary_phi, 1.0f);
+}
+
+TEST(LevelSetTests, SimpleCircleNarrowBand)
+{
+    glm::ivec2 size(50);
+    const float bandWidth = 4.0f;
+
+    LevelSet levelSet(*device, size, 2000);
+    Texture outTexture(*device, size.x, size.y, vk::Format::eR32Sfloat, VMA_MEMORY_USAGE_CPU_ONLY);
+
+    Ellipse circle(*device, glm::vec2{rad0} * glm::vec2(size));
+    circle.Position = glm::vec2(c0[0], c0[1]) * glm::vec2(size) - glm::vec2(0.5f);
+    circle.Colour = glm::vec4(0.5f);
+
+    Clear clear(glm::vec4(-0.5f));
+
+    levelSet.Record({clear, circle}).Submit();
+    levelSet.Reinitialise();
+
+    // Reinitialise again in the narrow band
+    levelSet.SetNarrowBand(bandWidth);
+    levelSet.Reinitialise();
+
+    device->Handle().waitIdle();
+
+    ExecuteCommand(*device, [&](vk::CommandBuffer commandBuffer)
+    {
+       outTexture.CopyFrom(commandBuffer, levelSet);
+    });
+
+    std::vector<float> pixels(size.x * size.y);
+    outTexture.CopyTo(pixels);
+
+    for (int j = 0; j < size.y; j++)
+    {
+        for (int i = 0; i < size.x; i++)
+        {
+            Vec2f pos((i + 1.0f) / size.x, (j + 1.0f) / size.x);
+            float value = size.x * boundary_phi(pos);
+            float readValue = pixels[i + j * size.x];
+
+            if (std::abs(value) < bandWidth - 1.0f)
+            {
+                EXPECT_LT(std::abs(value - readValue), 1.0f) << "Mismatch at " << i << ", " << j;
+            }
+            else
+            {
+                EXPECT_LE(std::abs(readValue), bandWidth + 1e-5f) << "Mismatch at " << i << ", " << j;
+            }
+        }
+    }
+}
+
+TEST(LevelSetTests, SimpleCircleConvergence)
+{
+    glm::ivec2 size(50);
+
+    LevelSet levelSet(*device, size, 2000);
+    levelSet.SetConvergenceCheck(1e-3f, 10);
+
+    Texture outTexture(*device, size.x, size.y, vk::Format::eR32Sfloat, VMA_MEMORY_USAGE_CPU_ONLY);
+
+    Ellipse circle(*device, glm::vec2{rad0} * glm::vec2(size));
+    circle.Position = glm::vec2(c0[0], c0[1]) * glm::vec2(size) - glm::vec2(0.5f);
+    circle.Colour = glm::vec4(0.5f);
+
+    Clear clear(glm::vec4(-0.5f));
+
+    levelSet.Record({clear, circle}).Submit();
+    levelSet.Reinitialise();
+
+    device->Handle().waitIdle();
+
+    ExecuteCommand(*device, [&](vk::CommandBuffer commandBuffer)
+    {
+       outTexture.CopyFrom(commandBuffer, levelSet);
+    });
+
+    CheckDifference(outTexture, boundary_phi, 1.0f);
+
+    // The iterations after convergence dispatched no work
+    int iterations = levelSet.GetConvergedIterations();
+    EXPECT_GT(iterations, 0);
+    EXPECT_LT(iterations, 1000);
+}
+
 TEST(LevelSetTests, Extrapolate)
 {
     glm::ivec2 size(50);
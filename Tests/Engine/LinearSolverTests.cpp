@@ -189,6 +189,87 @@ TEST(LinearSolverTests, Transfer_Restrict)
     EXPECT_FLOAT_EQ((11.0f + 12.0f + 15.0f + 16.0f) / 4.0f, outputData[1 + coarseSize.x * 1]);
 }
 
+TEST(LinearSolverTests, Transfer_ResidualRestrict)
+{
+    // larger than a tile, so the blocks on the edges of the tiles are checked
+    glm::ivec2 fineSize(40, 36);
+    glm::ivec2 coarseSize = fineSize / glm::ivec2(2);
+
+    Transfer t(*device);
+
+    std::vector<float> diagonalData(fineSize.x*fineSize.y);
+    std::vector<glm::vec2> lowerData(fineSize.x*fineSize.y);
+    std::vector<float> bData(fineSize.x*fineSize.y);
+    std::vector<float> xData(fineSize.x*fineSize.y);
+    for (int i = 0; i < fineSize.x*fineSize.y; i++)
+    {
+        diagonalData[i] = i % 7 == 0 ? 0.0f : 4.0f + (i % 3);
+        lowerData[i] = glm::vec2(-1.0f - (i % 2) * 0.5f, -1.0f + (i % 5) * 0.1f);
+        bData[i] = 0.1f * (i % 11) - 0.5f;
+        xData[i] = 0.2f * (i % 13) - 1.0f;
+    }
+
+    std::vector<float> coarseDiagonalData(coarseSize.x*coarseSize.y);
+    for (int i = 0; i < coarseSize.x*coarseSize.y; i++)
+    {
+        coarseDiagonalData[i] = i % 5 == 0 ? 0.0f : 1.0f;
+    }
+
+    Buffer<float> diagonal(*device, fineSize.x*fineSize.y, VMA_MEMORY_USAGE_CPU_ONLY);
+    Buffer<glm::vec2> lower(*device, fineSize.x*fineSize.y, VMA_MEMORY_USAGE_CPU_ONLY);
+    Buffer<float> b(*device, fineSize.x*fineSize.y, VMA_MEMORY_USAGE_CPU_ONLY);
+    Buffer<float> x(*device, fineSize.x*fineSize.y, VMA_MEMORY_USAGE_CPU_ONLY);
+    Buffer<float> coarseDiagonal(*device, coarseSize.x*coarseSize.y, VMA_MEMORY_USAGE_CPU_ONLY);
+
+    CopyFrom(diagonal, diagonalData);
+    CopyFrom(lower, lowerData);
+    CopyFrom(b, bData);
+    CopyFrom(x, xData);
+    CopyFrom(coarseDiagonal, coarseDiagonalData);
+
+    // baseline: residual of the interior cells, as computed by the residual kernel, then restricted
+    std::vector<float> residualData(fineSize.x*fineSize.y, 0.0f);
+    for (int j = 1; j < fineSize.y - 1; j++)
+    {
+        for (int i = 1; i < fineSize.x - 1; i++)
+        {
+            int index = i + j * fineSize.x;
+            residualData[index] = bData[index] - (lowerData[index + 1].x * xData[index + 1] +
+                                                  lowerData[index].x * xData[index - 1] +
+                                                  lowerData[index + fineSize.x].y * xData[index + fineSize.x] +
+                                                  lowerData[index].y * xData[index - fineSize.x] +
+                                                  diagonalData[index] * xData[index]);
+        }
+    }
+
+    Buffer<float> residual(*device, fineSize.x*fineSize.y, VMA_MEMORY_USAGE_CPU_ONLY);
+    CopyFrom(residual, residualData);
+
+    std::vector<float> zeros(coarseSize.x*coarseSize.y, 0.0f);
+    Buffer<float> restricted(*device, coarseSize.x*coarseSize.y, VMA_MEMORY_USAGE_CPU_ONLY);
+    Buffer<float> fused(*device, coarseSize.x*coarseSize.y, VMA_MEMORY_USAGE_CPU_ONLY);
+    CopyFrom(restricted, zeros);
+    CopyFrom(fused, zeros);
+
+    t.RestrictBind(0, fineSize, residual, diagonal, restricted, coarseDiagonal);
+    t.ResidualRestrictBind(0, fineSize, x, diagonal, lower, b, fused, coarseDiagonal);
+    ExecuteCommand(*device, [&](vk::CommandBuffer commandBuffer)
+    {
+        t.Restrict(commandBuffer, 0);
+        t.ResidualRestrict(commandBuffer, 0);
+    });
+
+    std::vector<float> restrictedData(coarseSize.x*coarseSize.y);
+    std::vector<float> fusedData(coarseSize.x*coarseSize.y);
+    CopyTo(restricted, restrictedData);
+    CopyTo(fused, fusedData);
+
+    for (int i = 0; i < coarseSize.x*coarseSize.y; i++)
+    {
+        EXPECT_NEAR(restrictedData[i], fusedData[i], 1e-5f) << "Mismatch at " << i;
+    }
+}
+
 TEST(LinearSolverTests, Simple_SOR)
 {
     glm::ivec2 size(50);
@@ -465,3 +546,43 @@ TEST(LinearSolverTests, Multigrid_Simple_PCG)
 
     std::cout << "Solved with number of iterations: " << params.OutIterations << std::endl;
 }
+
+TEST(LinearSolverTests, Telemetry_PCG)
+{
+    glm::ivec2 size(50);
+
+    FluidSim sim;
+    sim.initialize(1.0f, size.x, size.y);
+    sim.set_boundary(boundary_phi);
+
+    AddParticles(size, sim, boundary_phi);
+
+    sim.add_force(0.01f);
+    sim.compute_phi();
+    sim.extrapolate_phi();
+    sim.apply_projection(0.01f);
+
+    LinearSolver::Data data(*device, size, VMA_MEMORY_USAGE_CPU_ONLY);
+
+    BuildLinearEquation(size, data.Diagonal, data.Lower, data.B, sim);
+
+    Diagonal preconditioner(*device, size);
+    Telemetry telemetry(*device, 16);
+
+    LinearSolver::Parameters params(LinearSolver::Parameters::SolverType::Fixed, 10);
+    ConjugateGradient solver(*device, size, preconditioner);
+
+    solver.Bind(data.Diagonal, data.Lower, data.B, data.X);
+    solver.BindTelemetry(&telemetry);
+    solver.Solve(params);
+
+    device->Queue().waitIdle();
+
+    std::vector<float> residuals;
+    ASSERT_TRUE(telemetry.Read(residuals));
+    ASSERT_FALSE(telemetry.Read(residuals));
+
+    // initial residual plus one per iteration
+    ASSERT_EQ(params.OutIterations + 1, residuals.size());
+    EXPECT_LT(residuals.back(), residuals.front());
+}
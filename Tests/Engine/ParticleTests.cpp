@@ -8,7 +8,9 @@
 
 #include <random>
 #include <numeric>
+#include <cstring>
 #include <glm/gtx/io.hpp>
+#include <glm/gtx/transform.hpp>
 
 #include <Vortex2D/Renderer/Shapes.h>
 #include <Vortex2D/Engine/PrefixScan.h>
@@ -61,6 +63,12 @@ void PrintPrefixBuffer(const glm::ivec2& size, Buffer<int>& buffer)
     std::cout << std::endl;
 }
 
+glm::vec2 DecodeCompactPosition(uint32_t value, const glm::ivec2& cell)
+{
+    glm::ivec2 offset(static_cast<int16_t>(value & 0xFFFFu), static_cast<int16_t>(value >> 16u));
+    return glm::vec2(cell) + glm::vec2(offset) / 4096.0f;
+}
+
 void PrintPrefixVector(const std::vector<int>& data)
 {
     for (auto value: data)
@@ -140,14 +148,14 @@ TEST(ParticleTests, ParticleCounting)
 {
     glm::ivec2 size(20);
 
-    std::vector<Particle> particlesData(size.x*size.y*8);
-    particlesData[0].Position = glm::vec2(3.4f, 2.3f);
-    particlesData[1].Position = glm::vec2(3.5f, 2.4f);
-    particlesData[2].Position = glm::vec2(5.4f, 6.7f);
+    std::vector<glm::vec2> particlesData(size.x*size.y*8);
+    particlesData[0] = glm::vec2(3.4f, 2.3f);
+    particlesData[1] = glm::vec2(3.5f, 2.4f);
+    particlesData[2] = glm::vec2(5.4f, 6.7f);
     int numParticles = 3;
 
-    Buffer<Particle> particles(*device, 8*size.x*size.y, VMA_MEMORY_USAGE_CPU_ONLY);
-    CopyFrom(particles, particlesData);
+    Particles particles(*device, 8*size.x*size.y, false, false, false, VMA_MEMORY_USAGE_CPU_ONLY);
+    CopyFrom(particles.Position, particlesData);
 
     ParticleCount particleCount(*device, size, particles, {numParticles});
 
@@ -157,18 +165,126 @@ TEST(ParticleTests, ParticleCounting)
     ASSERT_EQ(numParticles, particleCount.GetTotalCount());
 }
 
+TEST(ParticleTests, ParticleLatestCount)
+{
+    glm::ivec2 size(20);
+
+    std::vector<glm::vec2> particlesData(size.x*size.y*8);
+    particlesData[0] = glm::vec2(3.4f, 2.3f);
+    particlesData[1] = glm::vec2(3.5f, 2.4f);
+    particlesData[2] = glm::vec2(5.4f, 6.7f);
+    int numParticles = 3;
+
+    Particles particles(*device, 8*size.x*size.y, false, false, false, VMA_MEMORY_USAGE_CPU_ONLY);
+    CopyFrom(particles.Position, particlesData);
+
+    ParticleCount particleCount(*device, size, particles, {numParticles});
+
+    EXPECT_EQ(-1, particleCount.GetLatestTotalCount());
+
+    particleCount.Scan();
+    device->Handle().waitIdle();
+
+    EXPECT_EQ(numParticles, particleCount.GetLatestTotalCount());
+
+    // Delete a particle
+    IntRectangle rect(*device, {1, 1});
+    rect.Position = glm::vec2(5.0f, 6.0f);
+    rect.Colour = glm::vec4(-8);
+
+    particleCount.Record({rect}).Submit();
+    particleCount.Scan();
+    device->Handle().waitIdle();
+
+    EXPECT_EQ(numParticles - 1, particleCount.GetLatestTotalCount());
+}
+
+TEST(ParticleTests, ParticleCapacity)
+{
+    glm::ivec2 size(20);
+
+    std::vector<glm::vec2> particlesData(4);
+    particlesData[0] = glm::vec2(3.4f, 2.3f);
+    particlesData[1] = glm::vec2(5.4f, 6.7f);
+    particlesData[2] = glm::vec2(13.4f, 16.7f);
+    int numParticles = 3;
+
+    Particles particles(*device, 4, false, false, false, VMA_MEMORY_USAGE_CPU_ONLY);
+    CopyFrom(particles.Position, particlesData);
+
+    ParticleCount particleCount(*device, size, particles, {numParticles});
+
+    particleCount.Scan();
+    device->Handle().waitIdle();
+
+    ASSERT_EQ(numParticles, particleCount.GetTotalCount());
+    EXPECT_EQ(numParticles, particleCount.GetHighWaterMark());
+
+    // Grow, all particles are kept
+    particleCount.SetCapacity(16);
+    EXPECT_EQ(16, particleCount.GetCapacity());
+
+    particleCount.Scan();
+    device->Handle().waitIdle();
+
+    ASSERT_EQ(numParticles, particleCount.GetTotalCount());
+
+    // Shrink, the buffers are kept until the particles fit and the added particles are kept pending
+    particleCount.SetCapacity(4);
+    EXPECT_EQ(16, particleCount.GetCapacity());
+
+    IntRectangle rect(*device, {1, 1});
+    rect.Position = glm::vec2(10.0f, 10.0f);
+    rect.Colour = glm::ivec4(4);
+
+    particleCount.Record({rect}).Submit();
+    particleCount.Scan();
+    device->Handle().waitIdle();
+
+    ASSERT_EQ(numParticles, particleCount.GetTotalCount());
+
+    EXPECT_TRUE(particleCount.UpdateCapacity());
+    EXPECT_EQ(4, particleCount.GetCapacity());
+
+    // The removed particles are removed even when the added particles don't fit
+    IntRectangle sink(*device, {1, 1});
+    sink.Position = glm::vec2(3.0f, 2.0f);
+    sink.Colour = glm::ivec4(-4);
+
+    particleCount.Record({sink}).Submit();
+    particleCount.Scan();
+    device->Handle().waitIdle();
+
+    ASSERT_EQ(numParticles - 1, particleCount.GetTotalCount());
+
+    // The pending particles are added once the capacity allows it
+    particleCount.SetCapacity(8);
+    EXPECT_EQ(8, particleCount.GetCapacity());
+
+    particleCount.Scan();
+    device->Handle().waitIdle();
+
+    ASSERT_EQ(numParticles - 1 + 4, particleCount.GetTotalCount());
+
+    std::vector<glm::vec2> outParticlesData(8);
+    CopyTo(particleCount.GetParticles().Position, outParticlesData);
+
+    EXPECT_EQ(outParticlesData[0], particlesData[1]);
+    EXPECT_EQ(outParticlesData[5], particlesData[2]);
+}
+
 TEST(ParticleTests, ParticleDelete)
 {
     glm::ivec2 size(20);
 
-    std::vector<Particle> particlesData(size.x*size.y*8);
-    particlesData[0].Position = glm::vec2(3.4f, 2.3f);
-    particlesData[1].Position = glm::vec2(13.4f, 16.7f);
-    particlesData[2].Position = glm::vec2(3.5f, 2.4f);
+    std::vector<glm::vec2> particlesData(size.x*size.y*8);
+    particlesData[0] = glm::vec2(3.4f, 2.3f);
+    particlesData[1] = glm::vec2(13.4f, 16.7f);
+    particlesData[2] = glm::vec2(3.5f, 2.4f);
     int numParticles = 3;
 
-    Buffer<Particle> particles(*device, 8*size.x*size.y, VMA_MEMORY_USAGE_CPU_ONLY);
-    CopyFrom(particles, particlesData);
+    Particles particles(*device, 8*size.x*size.y, false, false, false, VMA_MEMORY_USAGE_CPU_ONLY);
+    CopyFrom(particles.Position, particlesData);
 
     ParticleCount particleCount(*device, size, particles, {numParticles});
 
@@ -190,30 +306,121 @@ TEST(ParticleTests, ParticleDelete)
     ASSERT_EQ(2, particleCount.GetTotalCount());
 
     // Read particles
-    std::vector<Particle> outParticlesData(size.x*size.y*8);
-    CopyTo(particles, outParticlesData);
+    std::vector<glm::vec2> outParticlesData(size.x*size.y*8);
+    CopyTo(particleCount.GetParticles().Position, outParticlesData);
 
     // We don't know the order of particles in the same grid position
-    EXPECT_TRUE(outParticlesData[0].Position == particlesData[0].Position ||
-                outParticlesData[0].Position == particlesData[2].Position);
-    EXPECT_TRUE(outParticlesData[1].Position == particlesData[0].Position ||
-                outParticlesData[1].Position == particlesData[2].Position);
+    EXPECT_TRUE(outParticlesData[0] == particlesData[0] ||
+                outParticlesData[0] == particlesData[2]);
+    EXPECT_TRUE(outParticlesData[1] == particlesData[0] ||
+                outParticlesData[1] == particlesData[2]);
+}
+
+TEST(ParticleTests, ParticleCompact)
+{
+    glm::ivec2 size(20);
+
+    Particles particles(*device, 8*size.x*size.y, false, true, false, VMA_MEMORY_USAGE_CPU_ONLY);
+    ParticleCount particleCount(*device, size, particles);
+
+    // Add two particles in two cells
+    IntRectangle rect(*device, {2, 1});
+    rect.Position = glm::vec2(3.0f, 2.0f);
+    rect.Colour = glm::ivec4(2);
+
+    particleCount.Record({rect}).Submit();
+    particleCount.Scan();
+
+    // Sort the compact particles a second time
+    particleCount.Scan();
+    device->Handle().waitIdle();
+
+    ASSERT_EQ(4, particleCount.GetTotalCount());
+
+    // The cell of each particle is stored with it, x in the low 16 bits and y in the high 16 bits
+    std::vector<uint32_t> outCells(8*size.x*size.y);
+    CopyTo(particleCount.GetParticles().Cell, outCells);
+
+    // Two positions are stored in a vec2, relative to the cell they are sorted in
+    std::vector<glm::vec2> outParticlesData(4*size.x*size.y);
+    CopyTo(particleCount.GetParticles().Position, outParticlesData);
+
+    std::vector<uint32_t> outPositions(8*size.x*size.y);
+    std::memcpy(outPositions.data(), outParticlesData.data(), outPositions.size() * sizeof(uint32_t));
+
+    std::vector<glm::ivec2> cells = {{3, 2}, {3, 2}, {4, 2}, {4, 2}};
+    for (int i = 0; i < 4; i++)
+    {
+        EXPECT_EQ(cells[i], glm::ivec2(outCells[i] & 0xFFFFu, outCells[i] >> 16u));
+
+        glm::vec2 position = DecodeCompactPosition(outPositions[i], cells[i]);
+        EXPECT_EQ(cells[i], glm::ivec2(glm::floor(position)));
+    }
+
+    EXPECT_NE(outPositions[0], outPositions[1]);
+    EXPECT_NE(outPositions[2], outPositions[3]);
+
+    // 12 bytes per compact particle, 16 otherwise
+    Particles soaParticles(*device, 8*size.x*size.y, false, false, false, VMA_MEMORY_USAGE_CPU_ONLY);
+    auto particleSize = [](Particles& p)
+    {
+        return p.Position.Size() + p.Velocity.Size() + (p.Compact ? p.Cell.Size() : 0);
+    };
+    EXPECT_EQ(12u * 8 * size.x * size.y, particleSize(particles));
+    EXPECT_EQ(16u * 8 * size.x * size.y, particleSize(soaParticles));
+}
+
+TEST(ParticleTests, ParticleAttributes)
+{
+    glm::ivec2 size(20);
+
+    std::vector<glm::vec2> particlesData(size.x*size.y*8);
+    particlesData[0] = glm::vec2(13.4f, 16.7f);
+    particlesData[1] = glm::vec2(3.4f, 2.3f);
+    int numParticles = 2;
+
+    std::vector<glm::vec4> attributesData(size.x*size.y*8);
+    attributesData[0] = glm::vec4(1.0f);
+    attributesData[1] = glm::vec4(2.0f);
+
+    Particles particles(*device, 8*size.x*size.y, true, false, false, VMA_MEMORY_USAGE_CPU_ONLY);
+    CopyFrom(particles.Position, particlesData);
+    CopyFrom(particles.Attribute, attributesData);
+
+    ParticleCount particleCount(*device, size, particles, {numParticles});
+
+    // Particles are sorted by grid position, attributes need to follow
+    particleCount.Scan();
+    device->Queue().waitIdle();
+
+    ASSERT_EQ(2, particleCount.GetTotalCount());
+
+    std::vector<glm::vec2> outParticlesData(size.x*size.y*8);
+    CopyTo(particleCount.GetParticles().Position, outParticlesData);
+
+    std::vector<glm::vec4> outAttributesData(size.x*size.y*8);
+    CopyTo(particleCount.GetParticles().Attribute, outAttributesData);
+
+    EXPECT_EQ(outParticlesData[0], particlesData[1]);
+    EXPECT_EQ(outAttributesData[0], attributesData[1]);
+    EXPECT_EQ(outParticlesData[1], particlesData[0]);
+    EXPECT_EQ(outAttributesData[1], attributesData[0]);
 }
 
 TEST(ParticleTests, ParticleClamp)
 {
     glm::ivec2 size(20);
 
-    std::vector<Particle> particlesData(size.x*size.y*8);
+    std::vector<glm::vec2> particlesData(size.x*size.y*8);
 
     int numParticles = 10;
     for (int i = 0; i < numParticles; i++)
     {
-        particlesData[i].Position = glm::vec2(3.4f, 2.3f);
+        particlesData[i] = glm::vec2(3.4f, 2.3f);
     }
 
-    Buffer<Particle> particles(*device, 8*size.x*size.y, VMA_MEMORY_USAGE_CPU_ONLY);
-    CopyFrom(particles, particlesData);
+    Particles particles(*device, 8*size.x*size.y, false, false, false, VMA_MEMORY_USAGE_CPU_ONLY);
+    CopyFrom(particles.Position, particlesData);
 
     ParticleCount particleCount(*device, size, particles, {numParticles});
 
@@ -227,7 +434,7 @@ TEST(ParticleTests, ParticleSpawn)
 {
     glm::ivec2 size(20);
 
-    Buffer<Particle> particles(*device, 8*size.x*size.y, VMA_MEMORY_USAGE_CPU_ONLY);
+    Particles particles(*device, 8*size.x*size.y, false, false, false, VMA_MEMORY_USAGE_CPU_ONLY);
     ParticleCount particleCount(*device, size, particles);
 
     // Add some particles
@@ -245,35 +452,69 @@ TEST(ParticleTests, ParticleSpawn)
     ASSERT_EQ(4, particleNum);
 
     // Read particles
-    std::vector<Particle> outParticlesData(size.x*size.y*8);
-    CopyTo(particles, outParticlesData);
+    std::vector<glm::vec2> outParticlesData(size.x*size.y*8);
+    CopyTo(particleCount.GetParticles().Position, outParticlesData);
 
     glm::ivec2 particlePos(10, 10);
-    EXPECT_EQ(glm::ivec2(outParticlesData[0].Position), particlePos);
-    EXPECT_EQ(glm::ivec2(outParticlesData[1].Position), particlePos);
-    EXPECT_EQ(glm::ivec2(outParticlesData[2].Position), particlePos);
-    EXPECT_EQ(glm::ivec2(outParticlesData[3].Position), particlePos);
-
-    std::vector<glm::vec2> outParticles = {outParticlesData[0].Position,
-                                          outParticlesData[1].Position,
-                                          outParticlesData[2].Position,
-                                          outParticlesData[3].Position};
+    EXPECT_EQ(glm::ivec2(outParticlesData[0]), particlePos);
+    EXPECT_EQ(glm::ivec2(outParticlesData[1]), particlePos);
+    EXPECT_EQ(glm::ivec2(outParticlesData[2]), particlePos);
+    EXPECT_EQ(glm::ivec2(outParticlesData[3]), particlePos);
+
+    std::vector<glm::vec2> outParticles = {outParticlesData[0],
+                                          outParticlesData[1],
+                                          outParticlesData[2],
+                                          outParticlesData[3]};
     std::sort(outParticles.begin(), outParticles.end(),
               [](const auto& left, const auto&right) { return std::tie(left.x, left.y) < std::tie(right.x, right.y); });
     auto it = std::adjacent_find(outParticles.begin(), outParticles.end());
     ASSERT_EQ(it, outParticles.end());
 
+    std::vector<glm::vec2> outVelocitiesData(size.x*size.y*8);
+    CopyTo(particleCount.GetParticles().Velocity, outVelocitiesData);
+
     for (int i = 0; i < particleNum; i++)
     {
-        ASSERT_EQ(outParticlesData[i].Velocity, glm::vec2(0.0));
+        ASSERT_EQ(outVelocitiesData[i], glm::vec2(0.0));
     }
 }
 
+TEST(ParticleTests, ParticleSpawnSeed)
+{
+    glm::ivec2 size(20);
+
+    auto spawn = [&](uint32_t seed)
+    {
+        Particles particles(*device, 8*size.x*size.y, false, false, false, VMA_MEMORY_USAGE_CPU_ONLY);
+        ParticleCount particleCount(*device, size, particles);
+        particleCount.SetSeed(seed);
+
+        IntRectangle rect(*device, {2, 2});
+        rect.Position = glm::vec2(10.0f, 10.0f);
+        rect.Colour = glm::ivec4(4);
+
+        particleCount.Record({rect}).Submit();
+        particleCount.Scan();
+        device->Queue().waitIdle();
+
+        EXPECT_EQ(16, particleCount.GetTotalCount());
+
+        std::vector<glm::vec2> outParticlesData(size.x*size.y*8);
+        CopyTo(particleCount.GetParticles().Position, outParticlesData);
+        outParticlesData.resize(16);
+        return outParticlesData;
+    };
+
+    // Same seed spawns the same particles
+    EXPECT_EQ(spawn(42), spawn(42));
+    EXPECT_NE(spawn(42), spawn(43));
+}
+
 TEST(ParticleTests, ParticleAddDelete)
 {
     glm::ivec2 size(20);
 
-    Buffer<Particle> particles(*device, 8*size.x*size.y, VMA_MEMORY_USAGE_CPU_ONLY);
+    Particles particles(*device, 8*size.x*size.y, false, false, false, VMA_MEMORY_USAGE_CPU_ONLY);
     ParticleCount particleCount(*device, size, particles);
 
     // Add some particles
@@ -298,16 +539,102 @@ TEST(ParticleTests, ParticleAddDelete)
     particleCount.Scan();
     device->Queue().waitIdle();
 
+    // Two scans bring the particles back in the original buffer
+    EXPECT_EQ(&particles, &particleCount.GetParticles());
+
     // Read particles
-    std::vector<Particle> outParticlesData(size.x*size.y*8);
-    CopyTo(particles, outParticlesData);
+    std::vector<glm::vec2> outParticlesData(size.x*size.y*8);
+    CopyTo(particleCount.GetParticles().Position, outParticlesData);
 
     ASSERT_EQ(4, particleCount.GetTotalCount());
 
-    EXPECT_EQ(glm::ivec2(outParticlesData[0].Position), glm::ivec2(11, 10));
-    EXPECT_EQ(glm::ivec2(outParticlesData[1].Position), glm::ivec2(11, 11));
-    EXPECT_EQ(glm::ivec2(outParticlesData[2].Position), glm::ivec2(11, 12));
-    EXPECT_EQ(glm::ivec2(outParticlesData[3].Position), glm::ivec2(11, 13));
+    EXPECT_EQ(glm::ivec2(outParticlesData[0]), glm::ivec2(11, 10));
+    EXPECT_EQ(glm::ivec2(outParticlesData[1]), glm::ivec2(11, 11));
+    EXPECT_EQ(glm::ivec2(outParticlesData[2]), glm::ivec2(11, 12));
+    EXPECT_EQ(glm::ivec2(outParticlesData[3]), glm::ivec2(11, 13));
+}
+
+TEST(ParticleTests, ParticleEmitters)
+{
+    glm::ivec2 size(20);
+
+    Particles particles(*device, 8*size.x*size.y, false, false, false, VMA_MEMORY_USAGE_CPU_ONLY);
+    ParticleCount particleCount(*device, size, particles);
+
+    // A box of 2x2 cells and a circle covering a single cell
+    ParticleEmitter box = {{2.0f, 2.0f}, {2.0f, 2.0f}, 2.0f, ParticleEmitter::Shape::Box};
+    ParticleEmitter circle = {{10.5f, 10.5f}, {0.5f, 0.0f}, 3.0f, ParticleEmitter::Shape::Circle};
+
+    particleCount.SetEmitters({box, circle});
+    particleCount.Scan();
+    device->Queue().waitIdle();
+
+    ASSERT_EQ(11, particleCount.GetTotalCount());
+
+    // The emitters are only applied once
+    particleCount.Scan();
+    device->Queue().waitIdle();
+
+    ASSERT_EQ(11, particleCount.GetTotalCount());
+
+    // Sink removing the particles of the box
+    ParticleEmitter sink = {{2.0f, 2.0f}, {2.0f, 2.0f}, -8.0f, ParticleEmitter::Shape::Box};
+
+    particleCount.SetEmitters({sink});
+    particleCount.Scan();
+    device->Queue().waitIdle();
+
+    ASSERT_EQ(3, particleCount.GetTotalCount());
+
+    std::vector<glm::vec2> outParticlesData(size.x*size.y*8);
+    CopyTo(particleCount.GetParticles().Position, outParticlesData);
+
+    for (int i = 0; i < 3; i++)
+    {
+        EXPECT_EQ(glm::ivec2(outParticlesData[i]), glm::ivec2(10, 10));
+    }
+}
+
+TEST(ParticleTests, ParticleSprite)
+{
+    glm::ivec2 size(20);
+
+    std::vector<glm::vec2> particlesData(size.x*size.y*8);
+    particlesData[0] = glm::vec2(3.5f, 2.5f);
+    particlesData[1] = glm::vec2(13.5f, 6.5f);
+
+    Particles particles(*device, 8*size.x*size.y, false, false, false, VMA_MEMORY_USAGE_CPU_ONLY);
+    CopyFrom(particles.Position, particlesData);
+
+    ParticleCount particleCount(*device, size, particles, {2});
+
+    RenderTexture output(*device, size.x, size.y, vk::Format::eR8G8B8A8Unorm);
+    Texture localOutput(*device, size.x, size.y, vk::Format::eR8G8B8A8Unorm, VMA_MEMORY_USAGE_CPU_ONLY);
+
+    Clear clear({0.0f, 0.0f, 0.0f, 0.0f});
+    ParticleSprite sprite(*device, particleCount);
+
+    // Move the view so the first particle is culled
+    auto render = output.Record({clear, sprite});
+    render.Submit(glm::translate(glm::vec3(-10.0f, 0.0f, 0.0f)));
+    device->Handle().waitIdle();
+
+    ExecuteCommand(*device, [&](vk::CommandBuffer commandBuffer)
+    {
+        localOutput.CopyFrom(commandBuffer, output);
+    });
+
+    std::vector<glm::u8vec4> pixels(size.x*size.y);
+    localOutput.CopyTo(pixels);
+
+    for (int i = 0; i < size.x; i++)
+    {
+        for (int j = 0; j < size.y; j++)
+        {
+            glm::u8vec4 expected = (i == 3 && j == 6) ? glm::u8vec4(255) : glm::u8vec4(0);
+            EXPECT_EQ(expected, pixels[i + j * size.x]) << "Mismatch at " << i << "," << j;
+        }
+    }
 }
 
 void PrintLiquidPhi(const glm::ivec2& size, FluidSim& sim)
@@ -355,17 +682,15 @@ TEST(ParticleTests, Phi)
     AddParticles(size, sim, boundary_phi);
     sim.compute_phi();
 
-    Buffer<Particle> particles(*device, 8*size.x*size.y, VMA_MEMORY_USAGE_CPU_ONLY);
+    Particles particles(*device, 8*size.x*size.y, false, false, false, VMA_MEMORY_USAGE_CPU_ONLY);
 
-    std::vector<Particle> particlesData;
+    std::vector<glm::vec2> particlesData;
     for (auto& p: sim.particles)
     {
-        Particle particle;
-        particle.Position = glm::vec2(p[0] * size.x, p[1] * size.x);
-        particlesData.push_back(particle);
+        particlesData.push_back(glm::vec2(p[0] * size.x, p[1] * size.x));
     }
     particlesData.resize(8*size.x*size.y);
-    CopyFrom(particles, particlesData);
+    CopyFrom(particles.Position, particlesData);
 
     ParticleCount particleCount(*device, size, particles, {(int)sim.particles.size()});
 
@@ -405,18 +730,15 @@ TEST(ParticleTests, FromGrid_PIC)
    sim.update_from_grid(1.0f);
 
    // setup ParticleCount
-   Buffer<Particle> particles(*device, 8*size.x*size.y, VMA_MEMORY_USAGE_CPU_ONLY);
+   Particles particles(*device, 8*size.x*size.y, false, false, false, VMA_MEMORY_USAGE_CPU_ONLY);
 
-   std::vector<Particle> particlesData;
+   std::vector<glm::vec2> particlesData;
    for (std::size_t p = 0; p < sim.particles.size(); p++)
    {
-       Particle particle;
-       particle.Position = glm::vec2(sim.particles[p][0] * size.x, sim.particles[p][1] * size.x);
-       particle.Velocity = glm::vec2(0.0f);
-       particlesData.push_back(particle);
+       particlesData.push_back(glm::vec2(sim.particles[p][0] * size.x, sim.particles[p][1] * size.x));
    }
    particlesData.resize(8*size.x*size.y);
-   CopyFrom(particles, particlesData);
+   CopyFrom(particles.Position, particlesData);
 
    ParticleCount particleCount(*device, size, particles, {(int)sim.particles.size()}, alpha);
 
@@ -439,8 +761,11 @@ TEST(ParticleTests, FromGrid_PIC)
 
    // TODO check valid
 
-   std::vector<Particle> outParticlesData(size.x*size.y*8);
-   CopyTo(particles, outParticlesData);
+   std::vector<glm::vec2> outParticlesData(size.x*size.y*8);
+   CopyTo(particleCount.GetParticles().Position, outParticlesData);
+
+   std::vector<glm::vec2> outVelocitiesData(size.x*size.y*8);
+   CopyTo(particleCount.GetParticles().Velocity, outVelocitiesData);
 
    for (std::size_t i = 0; i < sim.particles.size(); i++)
    {
@@ -448,7 +773,7 @@ TEST(ParticleTests, FromGrid_PIC)
        for (std::size_t j = 0; j < sim.particles.size(); j++)
        {
            glm::vec2 pos(sim.particles[j][0] * size.x, sim.particles[j][1] * size.x);
-           if (pos == outParticlesData[i].Position)
+           if (pos == outParticlesData[i])
            {
                index = j;
            }
@@ -457,8 +782,8 @@ TEST(ParticleTests, FromGrid_PIC)
        ASSERT_NE(static_cast<std::size_t>(-1), index);
 
        glm::vec2 vel(sim.particles_velocity[index][0], sim.particles_velocity[index][1]);
-       EXPECT_NEAR(vel.x, outParticlesData[i].Velocity.x, 1e-5f);
-       EXPECT_NEAR(vel.y, outParticlesData[i].Velocity.y, 1e-5f);
+       EXPECT_NEAR(vel.x, outVelocitiesData[i].x, 1e-5f);
+       EXPECT_NEAR(vel.y, outVelocitiesData[i].y, 1e-5f);
    }
 }
 
@@ -481,18 +806,15 @@ TEST(ParticleTests, FromGrid_FLIP)
    sim.update_from_grid(1.0f);
 
    // setup ParticleCount
-   Buffer<Particle> particles(*device, 8*size.x*size.y, VMA_MEMORY_USAGE_CPU_ONLY);
+   Particles particles(*device, 8*size.x*size.y, false, false, false, VMA_MEMORY_USAGE_CPU_ONLY);
 
-   std::vector<Particle> particlesData;
+   std::vector<glm::vec2> particlesData;
    for (std::size_t p = 0; p < sim.particles.size(); p++)
    {
-       Particle particle;
-       particle.Position = glm::vec2(sim.particles[p][0] * size.x, sim.particles[p][1] * size.x);
-       particle.Velocity = glm::vec2(0.0f);
-       particlesData.push_back(particle);
+       particlesData.push_back(glm::vec2(sim.particles[p][0] * size.x, sim.particles[p][1] * size.x));
    }
    particlesData.resize(8*size.x*size.y);
-   CopyFrom(particles, particlesData);
+   CopyFrom(particles.Position, particlesData);
 
    ParticleCount particleCount(*device, size, particles, {(int)sim.particles.size()}, alpha);
 
@@ -517,8 +839,11 @@ TEST(ParticleTests, FromGrid_FLIP)
 
    // TODO check valid
 
-   std::vector<Particle> outParticlesData(size.x*size.y*8);
-   CopyTo(particles, outParticlesData);
+   std::vector<glm::vec2> outParticlesData(size.x*size.y*8);
+   CopyTo(particleCount.GetParticles().Position, outParticlesData);
+
+   std::vector<glm::vec2> outVelocitiesData(size.x*size.y*8);
+   CopyTo(particleCount.GetParticles().Velocity, outVelocitiesData);
 
    for (std::size_t i = 0; i < sim.particles.size(); i++)
    {
@@ -526,7 +851,7 @@ TEST(ParticleTests, FromGrid_FLIP)
        for (std::size_t j = 0; j < sim.particles.size(); j++)
        {
            glm::vec2 pos(sim.particles[j][0] * size.x, sim.particles[j][1] * size.x);
-           if (pos == outParticlesData[i].Position)
+           if (pos == outParticlesData[i])
            {
                index = j;
            }
@@ -535,8 +860,8 @@ TEST(ParticleTests, FromGrid_FLIP)
        ASSERT_NE(static_cast<std::size_t>(-1), index);
 
        glm::vec2 vel(sim.particles_velocity[index][0], sim.particles_velocity[index][1]);
-       EXPECT_NEAR(vel.x, outParticlesData[i].Velocity.x, 1e-5f);
-       EXPECT_NEAR(vel.y, outParticlesData[i].Velocity.y, 1e-5f);
+       EXPECT_NEAR(vel.x, outVelocitiesData[i].x, 1e-5f);
+       EXPECT_NEAR(vel.y, outVelocitiesData[i].y, 1e-5f);
    }
 }
 
@@ -562,18 +887,18 @@ TEST(ParticleTests, ToGrid)
    sim.transfer_to_grid();
 
    // setup ParticleCount
-   Buffer<Particle> particles(*device, 8*size.x*size.y, VMA_MEMORY_USAGE_CPU_ONLY);
+   Particles particles(*device, 8*size.x*size.y, false, false, false, VMA_MEMORY_USAGE_CPU_ONLY);
 
-   std::vector<Particle> particlesData;
+   std::vector<glm::vec2> particlesData, velocitiesData;
    for (std::size_t p = 0; p < sim.particles.size(); p++)
    {
-       Particle particle;
-       particle.Position = glm::vec2(sim.particles[p][0] * size.x, sim.particles[p][1] * size.x);
-       particle.Velocity = glm::vec2(sim.particles_velocity[p][0], sim.particles_velocity[p][1]);
-       particlesData.push_back(particle);
+       particlesData.push_back(glm::vec2(sim.particles[p][0] * size.x, sim.particles[p][1] * size.x));
+       velocitiesData.push_back(glm::vec2(sim.particles_velocity[p][0], sim.particles_velocity[p][1]));
    }
    particlesData.resize(8*size.x*size.y);
-   CopyFrom(particles, particlesData);
+   velocitiesData.resize(8*size.x*size.y);
+   CopyFrom(particles.Position, particlesData);
+   CopyFrom(particles.Velocity, velocitiesData);
 
    ParticleCount particleCount(*device, size, particles, {(int)sim.particles.size()}, alpha);
 
@@ -594,3 +919,85 @@ TEST(ParticleTests, ToGrid)
 
    CheckVelocity(*device, size, velocity, sim, 1e-5f);
 }
+
+TEST(ParticleTests, APIC_Linear)
+{
+    glm::ivec2 size(20);
+
+    // Linear velocity field, which the APIC transfers should preserve exactly
+    auto linearVelocity = [](const glm::vec2& pos)
+    {
+        return glm::vec2(0.02f * pos.x + 0.01f * pos.y, -0.01f * pos.x);
+    };
+
+    std::vector<glm::vec2> velocityData(size.x*size.y);
+    for (int i = 0; i < size.x; i++)
+    {
+        for (int j = 0; j < size.y; j++)
+        {
+            velocityData[i + j * size.x].x = linearVelocity(glm::vec2(i, j + 0.5f)).x;
+            velocityData[i + j * size.x].y = linearVelocity(glm::vec2(i + 0.5f, j)).y;
+        }
+    }
+
+    Texture input(*device, size.x, size.y, vk::Format::eR32G32Sfloat, VMA_MEMORY_USAGE_CPU_ONLY);
+    input.CopyFrom(velocityData);
+
+    Velocity velocity(*device, size);
+    ExecuteCommand(*device, [&](vk::CommandBuffer commandBuffer)
+    {
+        velocity.CopyFrom(commandBuffer, input);
+    });
+
+    // Four particles per cell
+    std::vector<glm::vec2> particlesData;
+    for (int i = 0; i < size.x; i++)
+    {
+        for (int j = 0; j < size.y; j++)
+        {
+            particlesData.push_back(glm::vec2(i + 0.25f, j + 0.25f));
+            particlesData.push_back(glm::vec2(i + 0.75f, j + 0.25f));
+            particlesData.push_back(glm::vec2(i + 0.25f, j + 0.75f));
+            particlesData.push_back(glm::vec2(i + 0.75f, j + 0.75f));
+        }
+    }
+    int numParticles = particlesData.size();
+    particlesData.resize(8*size.x*size.y);
+
+    Particles particles(*device, 8*size.x*size.y, false, false, true, VMA_MEMORY_USAGE_CPU_ONLY);
+    CopyFrom(particles.Position, particlesData);
+
+    ParticleCount particleCount(*device, size, particles, {numParticles});
+
+    particleCount.Scan();
+    device->Handle().waitIdle();
+
+    ASSERT_EQ(numParticles, particleCount.GetTotalCount());
+
+    Buffer<glm::ivec2> valid(*device, size.x*size.y, VMA_MEMORY_USAGE_CPU_ONLY);
+
+    particleCount.VelocitiesBind(velocity, valid);
+    particleCount.TransferFromGrid();
+    particleCount.TransferToGrid();
+    device->Handle().waitIdle();
+
+    Texture output(*device, size.x, size.y, vk::Format::eR32G32Sfloat, VMA_MEMORY_USAGE_CPU_ONLY);
+    ExecuteCommand(*device, [&](vk::CommandBuffer commandBuffer)
+    {
+        output.CopyFrom(commandBuffer, velocity);
+    });
+
+    std::vector<glm::vec2> pixels(size.x * size.y);
+    output.CopyTo(pixels);
+
+    // Away from the boundaries, where the interpolation reads outside the grid
+    for (int i = 2; i < size.x - 2; i++)
+    {
+        for (int j = 2; j < size.y - 2; j++)
+        {
+            auto index = i + j * size.x;
+            EXPECT_NEAR(velocityData[index].x, pixels[index].x, 1e-5f) << "Mismatch at " << i << "," << j;
+            EXPECT_NEAR(velocityData[index].y, pixels[index].y, 1e-5f) << "Mismatch at " << i << "," << j;
+        }
+    }
+}
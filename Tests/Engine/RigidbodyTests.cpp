@@ -189,7 +189,9 @@ TEST(RigidbodyTests, Div)
     rigidBody.RenderPhi();
 
     rigidBody.SetVelocities(glm::vec2(0.0f, 0.0f), 0.0f);
-    rigidBody.BindDiv(data.B, data.Diagonal);
+    Buffer<Vortex2D::Fluid::RigidBody::Constraint> constraints(*device, 1);
+    Buffer<int> constraintIds(*device, size.x*size.y);
+    rigidBody.BindDiv(data.B, data.Diagonal, constraints, constraintIds, 0);
     pressure.BuildLinearEquation();
     rigidBody.Div();
     device->Handle().waitIdle();
@@ -252,7 +254,9 @@ TEST(RigidbodyTests, VelocityDiv)
 
     // verify div
     rigidBody.SetVelocities(glm::vec2(v[0], v[1]) * glm::vec2(size.x), 0.0f);
-    rigidBody.BindDiv(data.B, data.Diagonal);
+    Buffer<Vortex2D::Fluid::RigidBody::Constraint> constraints(*device, 1);
+    Buffer<int> constraintIds(*device, size.x*size.y);
+    rigidBody.BindDiv(data.B, data.Diagonal, constraints, constraintIds, 0);
     pressure.BuildLinearEquation();
     rigidBody.Div();
 
@@ -315,7 +319,9 @@ TEST(RigidbodyTests, RotationDiv)
     rigidBody.RenderPhi();
 
     rigidBody.SetVelocities(glm::vec2(0.0f, 0.0f), w);
-    rigidBody.BindDiv(data.B, data.Diagonal);
+    Buffer<Vortex2D::Fluid::RigidBody::Constraint> constraints(*device, 1);
+    Buffer<int> constraintIds(*device, size.x*size.y);
+    rigidBody.BindDiv(data.B, data.Diagonal, constraints, constraintIds, 0);
     pressure.BuildLinearEquation();
     rigidBody.Div();
 
@@ -378,7 +384,9 @@ TEST(RigidbodyTests, VelocityRotationDiv)
     rigidBody.RenderPhi();
 
     rigidBody.SetVelocities(glm::vec2(v[0], v[1]) * glm::vec2(size.x), w);
-    rigidBody.BindDiv(data.B, data.Diagonal);
+    Buffer<Vortex2D::Fluid::RigidBody::Constraint> constraints(*device, 1);
+    Buffer<int> constraintIds(*device, size.x*size.y);
+    rigidBody.BindDiv(data.B, data.Diagonal, constraints, constraintIds, 0);
     pressure.BuildLinearEquation();
     rigidBody.Div();
 
@@ -794,13 +802,16 @@ TEST(RigidbodyTests, VelocityConstrain)
 
     Buffer<glm::ivec2> valid(*device, size.x*size.y, VMA_MEMORY_USAGE_CPU_ONLY);
 
+    LinearSolver::Data data(*device, size);
+
     Extrapolation extrapolation(*device, size, valid, velocity);
     extrapolation.ConstrainBind(solidPhi);
-    extrapolation.ConstrainVelocity();
+    extrapolation.RigidbodyBind(rigidBody, data.B, data.Diagonal);
 
     rigidBody.SetVelocities(solid_velocity * glm::vec2(size.x), 0.0f);
-    rigidBody.BindVelocityConstrain(velocity);
-    rigidBody.VelocityConstrain();
+    rigidBody.Div();
+    extrapolation.ConstrainVelocity();
+    velocity.Resolve();
 
     device->Handle().waitIdle();
 
@@ -866,13 +877,16 @@ TEST(RigidbodyTests, RotationConstrain)
 
     Buffer<glm::ivec2> valid(*device, size.x*size.y, VMA_MEMORY_USAGE_CPU_ONLY);
 
+    LinearSolver::Data data(*device, size);
+
     Extrapolation extrapolation(*device, size, valid, velocity);
     extrapolation.ConstrainBind(solidPhi);
-    extrapolation.ConstrainVelocity();
+    extrapolation.RigidbodyBind(rigidBody, data.B, data.Diagonal);
 
     rigidBody.SetVelocities(glm::vec2(0.0f, 0.0f), w);
-    rigidBody.BindVelocityConstrain(velocity);
-    rigidBody.VelocityConstrain();
+    rigidBody.Div();
+    extrapolation.ConstrainVelocity();
+    velocity.Resolve();
 
     device->Handle().waitIdle();
 
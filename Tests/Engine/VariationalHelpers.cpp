@@ -5,6 +5,8 @@
 
 #include "VariationalHelpers.h"
 
+#include <glm/gtc/packing.hpp>
+
 float circle_phi(const Vec2f& position, const Vec2f& centre, float radius)
 {
     return (dist(position,centre) - radius);
@@ -54,7 +56,7 @@ void SetVelocity(const Vortex2D::Renderer::Device& device,
                         Vortex2D::Fluid::Velocity& velocity,
                         FluidSim& sim)
 {
-    Vortex2D::Renderer::Texture input(device, size.x, size.y, vk::Format::eR32G32Sfloat, VMA_MEMORY_USAGE_CPU_ONLY);
+    Vortex2D::Renderer::Texture input(device, size.x, size.y, velocity.GetFormat(), VMA_MEMORY_USAGE_CPU_ONLY);
 
     std::vector<glm::vec2> velocityData(size.x * size.y, glm::vec2(0.0f));
     for (int i = 0; i < size.x; i++)
@@ -67,7 +69,21 @@ void SetVelocity(const Vortex2D::Renderer::Device& device,
         }
     }
 
-    input.CopyFrom(velocityData);
+    if (velocity.GetPrecision() == Vortex2D::Fluid::Velocity::Precision::Half)
+    {
+        std::vector<glm::uint> halfVelocityData(size.x * size.y);
+        for (std::size_t i = 0; i < velocityData.size(); i++)
+        {
+            halfVelocityData[i] = glm::packHalf2x16(velocityData[i]);
+        }
+
+        input.CopyFrom(halfVelocityData);
+    }
+    else
+    {
+        input.CopyFrom(velocityData);
+    }
+
     ExecuteCommand(device, [&](vk::CommandBuffer commandBuffer)
     {
         velocity.CopyFrom(commandBuffer, input);
@@ -246,14 +262,26 @@ void CheckVelocity(const Vortex2D::Renderer::Device& device,
                    FluidSim& sim,
                    float error)
 {
-    Vortex2D::Renderer::Texture output(device, size.x, size.y, vk::Format::eR32G32Sfloat, VMA_MEMORY_USAGE_CPU_ONLY);
+    Vortex2D::Renderer::Texture output(device, size.x, size.y, velocity.GetFormat(), VMA_MEMORY_USAGE_CPU_ONLY);
     ExecuteCommand(device, [&](vk::CommandBuffer commandBuffer)
     {
         output.CopyFrom(commandBuffer, velocity);
     });
 
     std::vector<glm::vec2> pixels(size.x * size.y);
-    output.CopyTo(pixels);
+    if (velocity.GetPrecision() == Vortex2D::Fluid::Velocity::Precision::Half)
+    {
+        std::vector<glm::uint> halfPixels(size.x * size.y);
+        output.CopyTo(halfPixels);
+        for (std::size_t i = 0; i < pixels.size(); i++)
+        {
+            pixels[i] = glm::unpackHalf2x16(halfPixels[i]);
+        }
+    }
+    else
+    {
+        output.CopyTo(pixels);
+    }
 
     // TODO need to check the entire velocity buffer
     for (int i = 1; i < size.x - 1; i++)
@@ -11,6 +11,8 @@
 #include <Vortex2D/Engine/Boundaries.h>
 #include <Vortex2D/Engine/Density.h>
 #include <Vortex2D/Engine/Cfl.h>
+#include <Vortex2D/Engine/Particles.h>
+#include <Vortex2D/Renderer/Shapes.h>
 
 #include <cmath>
 #include <random>
@@ -186,6 +188,159 @@ TEST(WorldTests, VelocityScale)
     CheckVelocity(*device, size, world.GetVelocity(), velocityData);
 }
 
+TEST(WorldTests, Forces)
+{
+    float dt = 0.01f;
+    glm::ivec2 size(50);
+
+    Fluid::Velocity velocity(*device, size);
+    Fluid::Forces forces(*device, size, dt, velocity);
+
+    Renderer::ExecuteCommand(*device, [&](vk::CommandBuffer commandBuffer)
+    {
+        velocity.Clear(commandBuffer);
+    });
+
+    Fluid::Force gravity = {{0.0f, 0.0f}, {0.0f, -10.0f}, 0.0f, Fluid::Force::Kind::Directional};
+    Fluid::Force impulse = {{25.0f, 25.0f}, {2.0f, 1.0f}, 5.0f, Fluid::Force::Kind::Impulse};
+    forces.Add(gravity);
+    forces.Add(impulse);
+    forces.Apply();
+    device->Handle().waitIdle();
+
+    auto falloff = [&](const glm::vec2& pos)
+    {
+        float d = glm::distance(pos, impulse.Position);
+        if (d >= impulse.Radius) return 0.0f;
+        float x = d / impulse.Radius;
+        return (1.0f - x * x) * (1.0f - x * x);
+    };
+
+    std::vector<glm::vec2> velocityData(size.x * size.y);
+    for (int i = 0; i < size.x; i++)
+    {
+        for (int j = 0; j < size.y; j++)
+        {
+            glm::vec2 uv;
+            uv.x = impulse.Value.x * falloff(glm::vec2(i, j + 0.5f));
+            uv.y = dt * gravity.Value.y + impulse.Value.y * falloff(glm::vec2(i + 0.5f, j));
+            velocityData[i + j * size.x] = uv / float(size.x);
+        }
+    }
+
+    CheckVelocity(*device, size, velocity, velocityData, 1e-5f);
+}
+
+TEST(WorldTests, Probes)
+{
+    glm::ivec2 size(50);
+
+    Fluid::Velocity velocity(*device, size);
+    Renderer::Texture liquidPhi(*device, size.x, size.y, vk::Format::eR32Sfloat);
+    Renderer::Texture solidPhi(*device, size.x, size.y, vk::Format::eR32Sfloat);
+    Fluid::Probes probes(*device, velocity, liquidPhi, solidPhi, 16);
+
+    // Linear fields, exactly interpolated: u is at (i, j + 0.5), v at (i + 0.5, j),
+    // the liquid phi at (i + 0.5, j + 0.5) and the solid phi at (i, j).
+    Renderer::Texture localVelocity(*device, size.x, size.y, vk::Format::eR32G32Sfloat, VMA_MEMORY_USAGE_CPU_ONLY);
+    Renderer::Texture localLiquidPhi(*device, size.x, size.y, vk::Format::eR32Sfloat, VMA_MEMORY_USAGE_CPU_ONLY);
+    Renderer::Texture localSolidPhi(*device, size.x, size.y, vk::Format::eR32Sfloat, VMA_MEMORY_USAGE_CPU_ONLY);
+
+    std::vector<glm::vec2> velocityData(size.x * size.y);
+    std::vector<float> liquidPhiData(size.x * size.y), solidPhiData(size.x * size.y);
+    for (int i = 0; i < size.x; i++)
+    {
+        for (int j = 0; j < size.y; j++)
+        {
+            std::size_t index = i + size.x * j;
+            velocityData[index] = glm::vec2(i, 2.0f * j) / float(size.x);
+            liquidPhiData[index] = i + 0.5f;
+            solidPhiData[index] = -float(j);
+        }
+    }
+
+    localVelocity.CopyFrom(velocityData);
+    localLiquidPhi.CopyFrom(liquidPhiData);
+    localSolidPhi.CopyFrom(solidPhiData);
+    Renderer::ExecuteCommand(*device, [&](vk::CommandBuffer commandBuffer)
+    {
+        velocity.CopyFrom(commandBuffer, localVelocity);
+        liquidPhi.CopyFrom(commandBuffer, localLiquidPhi);
+        solidPhi.CopyFrom(commandBuffer, localSolidPhi);
+    });
+
+    std::vector<glm::vec2> points = {{10.0f, 10.0f}, {12.3f, 25.7f}, {40.1f, 3.9f}};
+
+    std::vector<Fluid::ProbeSample> samples;
+    EXPECT_FALSE(probes.Read(samples));
+
+    probes.Sample(points);
+    device->Handle().waitIdle();
+
+    ASSERT_TRUE(probes.Read(samples));
+    ASSERT_EQ(points.size(), samples.size());
+    for (std::size_t i = 0; i < points.size(); i++)
+    {
+        EXPECT_NEAR(points[i].x, samples[i].Velocity.x, 1e-2f);
+        EXPECT_NEAR(2.0f * points[i].y, samples[i].Velocity.y, 1e-2f);
+        EXPECT_NEAR(points[i].x, samples[i].LiquidPhi, 1e-2f);
+        EXPECT_NEAR(-points[i].y, samples[i].SolidPhi, 1e-2f);
+    }
+
+    EXPECT_FALSE(probes.Read(samples));
+}
+
+TEST(WorldTests, WaterParticleSprite)
+{
+    float dt = 0.01f;
+    glm::ivec2 size(20);
+
+    Fluid::WaterWorld world(*device, size, dt);
+
+    Renderer::IntRectangle fluid(*device, {6, 4});
+    fluid.Position = glm::vec2(5.0f, 5.0f);
+    fluid.Colour = glm::vec4(4);
+
+    world.RecordParticleCount({fluid}).Submit().Wait();
+    world.Step();
+
+    Renderer::RenderTexture output(*device, size.x, size.y, vk::Format::eR8G8B8A8Unorm);
+    Renderer::Texture localOutput(*device, size.x, size.y, vk::Format::eR8G8B8A8Unorm, VMA_MEMORY_USAGE_CPU_ONLY);
+
+    Renderer::Clear clear({0.0f, 0.0f, 0.0f, 0.0f});
+    Fluid::ParticleSprite sprite(*device, world.GetParticleCount());
+
+    auto render = output.Record({clear, sprite});
+    render.Submit();
+    device->Handle().waitIdle();
+
+    Renderer::ExecuteCommand(*device, [&](vk::CommandBuffer commandBuffer)
+    {
+        localOutput.CopyFrom(commandBuffer, output);
+    });
+
+    std::vector<glm::u8vec4> pixels(size.x*size.y);
+    localOutput.CopyTo(pixels);
+
+    // The squares of the particles cover the centre of their cell and can overlap the neighbouring cells
+    for (int i = 0; i < size.x; i++)
+    {
+        for (int j = 0; j < size.y; j++)
+        {
+            bool inside = i >= 5 && i < 11 && j >= 5 && j < 9;
+            bool outside = i < 4 || i > 11 || j < 4 || j > 9;
+            if (inside)
+            {
+                EXPECT_EQ(glm::u8vec4(255), pixels[i + j * size.x]) << "Mismatch at " << i << "," << j;
+            }
+            else if (outside)
+            {
+                EXPECT_EQ(glm::u8vec4(0), pixels[i + j * size.x]) << "Mismatch at " << i << "," << j;
+            }
+        }
+    }
+}
+
 TEST(CflTets, Max)
 {
     glm::ivec2 size(50);
@@ -11,6 +11,7 @@
 #include <Vortex2D/Renderer/Work.h>
 #include <Vortex2D/Renderer/CommandBuffer.h>
 #include <Vortex2D/Renderer/Timer.h>
+#include <Vortex2D/Renderer/Readback.h>
 #include <Vortex2D/Renderer/DescriptorSet.h>
 #include <Vortex2D/SPIRV/Reflection.h>
 
@@ -415,6 +416,59 @@ TEST(ComputeTests, Timer)
     std::cout << "Elapsed time: " << time << std::endl;
 }
 
+TEST(ComputeTests, Readback)
+{
+    glm::ivec2 size(20);
+    glm::ivec2 rectOffset(3, 5), rectSize(8, 6);
+
+    Texture localTexture(*device, size.x, size.y, vk::Format::eR32Sfloat, VMA_MEMORY_USAGE_CPU_ONLY);
+    Texture texture(*device, size.x, size.y, vk::Format::eR32Sfloat);
+    Buffer<float> buffer(*device, size.x*size.y, VMA_MEMORY_USAGE_CPU_TO_GPU);
+
+    std::vector<float> data(size.x*size.y);
+    for (std::size_t i = 0; i < data.size(); i++)
+    {
+        data[i] = static_cast<float>(i);
+    }
+
+    localTexture.CopyFrom(data);
+    CopyFrom(buffer, data);
+
+    ExecuteCommand(*device, [&](vk::CommandBuffer commandBuffer)
+    {
+       texture.CopyFrom(commandBuffer, localTexture);
+    });
+
+    Readback readback(*device, sizeof(float) * size.x * size.y, 2);
+    readback.CopyFrom(texture, rectOffset, rectSize);
+    readback.CopyFrom(buffer, sizeof(float) * 30, sizeof(float) * 10);
+
+    EXPECT_THROW(readback.CopyFrom(texture, rectOffset, glm::ivec2(0, 4)), std::runtime_error);
+    EXPECT_THROW(readback.CopyFrom(texture, glm::ivec2(15), glm::ivec2(8)), std::runtime_error);
+
+    Texture vec4Texture(*device, size.x, size.y, vk::Format::eR32G32B32A32Sfloat);
+    EXPECT_THROW(readback.CopyFrom(vec4Texture, glm::ivec2(0), size), std::runtime_error);
+
+    device->Handle().waitIdle();
+
+    std::vector<float> rect;
+    ASSERT_TRUE(readback.Read(rect));
+    ASSERT_EQ(static_cast<std::size_t>(rectSize.x * rectSize.y), rect.size());
+    for (int j = 0; j < rectSize.y; j++)
+    {
+        for (int i = 0; i < rectSize.x; i++)
+        {
+            EXPECT_EQ(data[(j + rectOffset.y) * size.x + i + rectOffset.x], rect[j * rectSize.x + i]);
+        }
+    }
+
+    std::vector<float> range;
+    ASSERT_TRUE(readback.Read(range));
+    ASSERT_EQ(std::vector<float>(data.begin() + 30, data.begin() + 40), range);
+
+    ASSERT_FALSE(readback.Read(range));
+}
+
 TEST(ComputeTests, Reflection)
 {
   Reflection spirv1(Stencil_comp);
@@ -8,78 +8,480 @@
 #include <Vortex2D/Renderer/Pipeline.h>
 #include <Vortex2D/Engine/Density.h>
 
+#include <algorithm>
+
 #include "vortex2d_generated_spirv.h"
 
 namespace Vortex2D { namespace Fluid {
 
+namespace
+{
+// Selects the bilinear interpolation of CommonSampler.comp when the formats can't be filtered
+Renderer::SpecConstInfo FilterSpecConst(bool linearFilter)
+{
+    return Renderer::SpecConst(Renderer::SpecConstValue(3, linearFilter ? 1 : 0));
+}
+}
 
-Advection::Advection(const Renderer::Device& device, const glm::ivec2& size, float dt, Velocity& velocity)
-    : mDt(dt)
+Advection::Advection(const Renderer::Device& device,
+                     const glm::ivec2& size,
+                     float dt,
+                     Velocity& velocity,
+                     Method method)
+    : mDevice(device)
+    , mDt(dt)
     , mSize(size)
     , mVelocity(velocity)
-    , mVelocityAdvect(device, size, SPIRV::AdvectVelocity_comp)
-    , mVelocityAdvectBound(mVelocityAdvect.Bind({velocity, velocity.Output()}))
-    , mAdvect(device, size, SPIRV::Advect_comp)
-    , mAdvectParticles(device, Renderer::ComputeSize::Default1D(), SPIRV::AdvectParticles_comp)
-    , mAdvectVelocityCmd(device, false)
-    , mAdvectCmd(device, false)
-    , mAdvectParticlesCmd(device, false)
-{
-    mAdvectVelocityCmd.Record([&](vk::CommandBuffer commandBuffer)
+    , mMethod(method)
+    , mLinearFilter(Renderer::IsLinearFilterSupported(device, velocity.GetFormat()) &&
+                    Renderer::IsLinearFilterSupported(device, vk::Format::eR32Sfloat))
+    , mSampler(Renderer::SamplerBuilder()
+               .AddressMode(vk::SamplerAddressMode::eClampToBorder)
+               .Filter(mLinearFilter ? vk::Filter::eLinear : vk::Filter::eNearest)
+               .Create(device.Handle()))
+    , mVelocityAdvect(device, size, velocity.SelectSpirv(SPIRV::AdvectVelocity_comp, SPIRV::AdvectVelocityHalf_comp), FilterSpecConst(mLinearFilter))
+    , mVelocityCorrect(device, size, velocity.SelectSpirv(SPIRV::AdvectVelocityCorrect_comp, SPIRV::AdvectVelocityCorrectHalf_comp), FilterSpecConst(mLinearFilter))
+    , mAdvectTrace(device, size, velocity.SelectSpirv(SPIRV::AdvectTrace_comp, SPIRV::AdvectTraceHalf_comp), FilterSpecConst(mLinearFilter))
+    , mAdvectFieldRgba8(device, size, SPIRV::AdvectFieldRgba8_comp, FilterSpecConst(mLinearFilter))
+    , mAdvectFieldR32f(device, size, SPIRV::AdvectFieldR32f_comp, FilterSpecConst(mLinearFilter))
+    , mAdvectFieldDirectRgba8(device, size, velocity.SelectSpirv(SPIRV::AdvectFieldDirectRgba8_comp, SPIRV::AdvectFieldDirectRgba8Half_comp), FilterSpecConst(mLinearFilter))
+    , mAdvectFieldDirectR32f(device, size, velocity.SelectSpirv(SPIRV::AdvectFieldDirectR32f_comp, SPIRV::AdvectFieldDirectR32fHalf_comp), FilterSpecConst(mLinearFilter))
+    , mAdvectFieldsRgba8(device, size, SPIRV::AdvectFieldsRgba8_comp, FilterSpecConst(mLinearFilter))
+    , mAdvectFieldsR32f(device, size, SPIRV::AdvectFieldsR32f_comp, FilterSpecConst(mLinearFilter))
+    , mAdvectFieldCorrectRgba8(device, size, SPIRV::AdvectFieldCorrectRgba8_comp)
+    , mAdvectFieldCorrectR32f(device, size, SPIRV::AdvectFieldCorrectR32f_comp)
+    , mAdvectParticles(device, Renderer::ComputeSize::Default1D(), velocity.SelectSpirv(SPIRV::AdvectParticles_comp, SPIRV::AdvectParticlesHalf_comp), FilterSpecConst(mLinearFilter))
+    , mParticleCount(nullptr)
+{
+    if (mMethod != Method::SemiLagrangian)
+    {
+        mVelocityForward = std::make_unique<Renderer::Texture>(device, size.x, size.y, velocity.GetFormat());
+    }
+
+    // The velocity is advected to its output field, which is then swapped with the input field.
+    // The kernels reading the velocity are bound for both parities.
+    for (int parity = 0; parity < 2; parity++)
+    {
+        auto& input = velocity.Input(parity);
+        auto& output = velocity.Output(parity);
+
+        mVelocityAdvectBound.push_back(mVelocityAdvect.Bind({input,
+                                                             {*mSampler, input},
+                                                             output,
+                                                             {*mSampler, input}}));
+        if (mMethod != Method::SemiLagrangian)
+        {
+            // The backward step is written to the output, then corrected in place.
+            // For BFECC, the corrected velocity replaces the forward step and is advected again.
+            auto& corrected = mMethod == Method::MacCormack ? output : *mVelocityForward;
+            mVelocityForwardBound.push_back(mVelocityAdvect.Bind({input,
+                                                                  {*mSampler, input},
+                                                                  *mVelocityForward,
+                                                                  {*mSampler, input}}));
+            mVelocityBackwardBound.push_back(mVelocityAdvect.Bind({input,
+                                                                   {*mSampler, *mVelocityForward},
+                                                                   output,
+                                                                   {*mSampler, input}}));
+            mVelocityCorrectBound.push_back(mVelocityCorrect.Bind({input,
+                                                                   *mVelocityForward,
+                                                                   output,
+                                                                   corrected,
+                                                                   {*mSampler, input}}));
+        }
+    }
+
+    RecordAdvectVelocity();
+}
+
+void Advection::RecordAdvectVelocity()
+{
+    for (int parity = 0; parity < 2; parity++)
     {
-        mVelocityAdvectBound.PushConstant(commandBuffer, dt);
-        mVelocityAdvectBound.Record(commandBuffer);
-        velocity.CopyBack(commandBuffer);
-    });
+        mAdvectVelocityCmd.emplace_back(mDevice, false);
+        mAdvectVelocityCmd.back().Record([&, parity](vk::CommandBuffer commandBuffer)
+        {
+            commandBuffer.debugMarkerBeginEXT({"Advect velocity", {{ 0.35f, 0.62f, 0.88f, 1.0f}}});
+
+            auto barrier = [&](Renderer::Texture& texture)
+            {
+                texture.Barrier(commandBuffer,
+                                vk::ImageLayout::eGeneral, vk::AccessFlagBits::eShaderWrite,
+                                vk::ImageLayout::eGeneral, vk::AccessFlagBits::eShaderRead);
+            };
+
+            if (mMethod == Method::SemiLagrangian)
+            {
+                mVelocityAdvectBound[parity].PushConstant(commandBuffer, mDt, 0);
+                mVelocityAdvectBound[parity].Record(commandBuffer);
+            }
+            else
+            {
+                mVelocityForwardBound[parity].PushConstant(commandBuffer, mDt, 0);
+                mVelocityForwardBound[parity].Record(commandBuffer);
+                barrier(*mVelocityForward);
+
+                mVelocityBackwardBound[parity].PushConstant(commandBuffer, -mDt, 0);
+                mVelocityBackwardBound[parity].Record(commandBuffer);
+                barrier(mVelocity.Output(parity));
+
+                int mode = mMethod == Method::MacCormack ? 0 : 1;
+                mVelocityCorrectBound[parity].PushConstant(commandBuffer, mDt, mode);
+                mVelocityCorrectBound[parity].Record(commandBuffer);
+
+                if (mMethod == Method::BFECC)
+                {
+                    barrier(*mVelocityForward);
+
+                    // Advect the corrected velocity, limited by the original velocity
+                    mVelocityBackwardBound[parity].PushConstant(commandBuffer, mDt, 1);
+                    mVelocityBackwardBound[parity].Record(commandBuffer);
+                }
+            }
+
+            barrier(mVelocity.Output(parity));
+            commandBuffer.debugMarkerEndEXT();
+        });
+    }
 }
 
 void Advection::AdvectVelocity()
 {
-    mAdvectVelocityCmd.Submit();
+    // The advected velocity is in the output field, which becomes the input
+    mAdvectVelocityCmd[mVelocity.GetParity()].Submit();
+    mVelocity.Swap();
+}
+
+Advection::AdvectedField::AdvectedField(Density& field)
+    : Field(field)
+{
 }
 
 void Advection::AdvectBind(Density& density)
 {
-    mAdvectBound = mAdvect.Bind({mVelocity, density, density.mFieldBack});
-    mAdvectCmd.Record([&](vk::CommandBuffer commandBuffer)
+    AdvectBind(FieldList{density});
+}
+
+Renderer::Work& Advection::GetFieldWork(vk::Format format, FieldKernel kernel)
+{
+    switch (format)
+    {
+        case vk::Format::eR8G8B8A8Unorm:
+        case vk::Format::eB8G8R8A8Unorm:
+            switch (kernel)
+            {
+                case FieldKernel::Advect: return mAdvectFieldRgba8;
+                case FieldKernel::Correct: return mAdvectFieldCorrectRgba8;
+                case FieldKernel::Direct: return mAdvectFieldDirectRgba8;
+                case FieldKernel::Batch: return mAdvectFieldsRgba8;
+            }
+            break;
+        case vk::Format::eR32Sfloat:
+            switch (kernel)
+            {
+                case FieldKernel::Advect: return mAdvectFieldR32f;
+                case FieldKernel::Correct: return mAdvectFieldCorrectR32f;
+                case FieldKernel::Direct: return mAdvectFieldDirectR32f;
+                case FieldKernel::Batch: return mAdvectFieldsR32f;
+            }
+            break;
+        default:
+            break;
+    }
+
+    throw std::runtime_error("Unsupported field format for advection");
+}
+
+void Advection::BindFieldBatches()
+{
+    // Fields of the same kernel format are grouped by four, the unused slots of a batch are bound to its first field
+    const std::size_t batchSize = 4;
+    for (auto kernelFormat: {vk::Format::eR8G8B8A8Unorm, vk::Format::eR32Sfloat})
+    {
+        std::vector<Density*> fields;
+        for (auto& advected: mFields)
+        {
+            if (&GetFieldWork(advected.Field.GetFormat(), FieldKernel::Batch) == &GetFieldWork(kernelFormat, FieldKernel::Batch))
+            {
+                fields.push_back(&advected.Field);
+            }
+        }
+
+        for (std::size_t i = 0; i < fields.size(); i += batchSize)
+        {
+            FieldBatch batch;
+            batch.Fields.assign(fields.begin() + i, fields.begin() + std::min(i + batchSize, fields.size()));
+
+            std::vector<Renderer::BindingInput> inputs = {*mTrace};
+            for (std::size_t j = 0; j < batchSize; j++)
+            {
+                auto& field = *batch.Fields[j < batch.Fields.size() ? j : 0];
+                inputs.push_back({*mSampler, field});
+            }
+            for (std::size_t j = 0; j < batchSize; j++)
+            {
+                auto& field = *batch.Fields[j < batch.Fields.size() ? j : 0];
+                inputs.push_back(field.mFieldBack);
+            }
+
+            batch.Bound = GetFieldWork(kernelFormat, FieldKernel::Batch).Bind(inputs);
+            mFieldBatches.push_back(std::move(batch));
+        }
+    }
+}
+
+void Advection::AdvectBind(FieldList fields)
+{
+    // The advect command could still be executing
+    for (auto& advectCmd: mAdvectCmd)
     {
-        mAdvectBound.PushConstant(commandBuffer, mDt);
-        mAdvectBound.Record(commandBuffer);
-        density.mFieldBack.Barrier(commandBuffer,
-                      vk::ImageLayout::eGeneral,
-                      vk::AccessFlagBits::eShaderWrite,
-                      vk::ImageLayout::eGeneral,
-                      vk::AccessFlagBits::eShaderRead);
-        density.CopyFrom(commandBuffer, density.mFieldBack);
-    });
+        advectCmd.Wait();
+    }
+
+    // The back-trajectories are only stored for several fields or the high order methods,
+    // a single field is traced inline
+    bool direct = mMethod == Method::SemiLagrangian && fields.size() == 1;
+    if (!direct && !mTrace)
+    {
+        mTrace = std::make_unique<Renderer::Buffer<glm::vec2>>(mDevice, mSize.x*mSize.y);
+        for (int parity = 0; parity < 2; parity++)
+        {
+            auto& input = mVelocity.Input(parity);
+            mAdvectTraceBound.push_back(mAdvectTrace.Bind({input, {*mSampler, input}, *mTrace}));
+        }
+    }
+    if (mMethod != Method::SemiLagrangian && !mTraceBack)
+    {
+        mTraceBack = std::make_unique<Renderer::Buffer<glm::vec2>>(mDevice, mSize.x*mSize.y);
+        for (int parity = 0; parity < 2; parity++)
+        {
+            auto& input = mVelocity.Input(parity);
+            mAdvectTraceBackBound.push_back(mAdvectTrace.Bind({input, {*mSampler, input}, *mTraceBack}));
+        }
+    }
+
+    mFields.clear();
+    mFieldBatches.clear();
+    mFields.reserve(fields.size());
+    for (auto& field: fields)
+    {
+        mFields.emplace_back(field.get());
+        auto& advected = mFields.back();
+        auto& density = advected.Field;
+        auto& advect = GetFieldWork(density.GetFormat(), FieldKernel::Advect);
+
+        if (mMethod == Method::SemiLagrangian)
+        {
+            if (direct)
+            {
+                // A single field is traced and sampled in the same dispatch, without the trace buffer
+                for (int parity = 0; parity < 2; parity++)
+                {
+                    auto& velocity = mVelocity.Input(parity);
+                    advected.DirectBound.push_back(GetFieldWork(density.GetFormat(), FieldKernel::Direct).Bind({{*mSampler, density},
+                                                                                                               velocity,
+                                                                                                               {*mSampler, density},
+                                                                                                               density.mFieldBack,
+                                                                                                               {*mSampler, velocity}}));
+                }
+            }
+        }
+        else
+        {
+            advected.Forward = std::make_unique<Renderer::Texture>(mDevice, mSize.x, mSize.y, density.GetFormat());
+            advected.Backward = std::make_unique<Renderer::Texture>(mDevice, mSize.x, mSize.y, density.GetFormat());
+
+            advected.ForwardBound = advect.Bind({{*mSampler, density},
+                                                 *mTrace,
+                                                 {*mSampler, density},
+                                                 *advected.Forward});
+            advected.BackwardBound = advect.Bind({{*mSampler, *advected.Forward},
+                                                  *mTraceBack,
+                                                  {*mSampler, density},
+                                                  *advected.Backward});
+
+            // The corrected field is written to the back field. For BFECC, it is then advected again
+            // to the forward field.
+            advected.CorrectBound = GetFieldWork(density.GetFormat(), FieldKernel::Correct).Bind({{*mSampler, density},
+                                                                                                 {*mSampler, *advected.Forward},
+                                                                                                 {*mSampler, *advected.Backward},
+                                                                                                 *mTrace,
+                                                                                                 density.mFieldBack});
+            advected.CorrectedBound = advect.Bind({{*mSampler, density.mFieldBack},
+                                                   *mTrace,
+                                                   {*mSampler, density},
+                                                   *advected.Forward});
+        }
+    }
+
+    if (mMethod == Method::SemiLagrangian && !direct)
+    {
+        BindFieldBatches();
+    }
+
+    mAdvectCmd.clear();
+    for (int parity = 0; parity < 2; parity++)
+    {
+        mAdvectCmd.emplace_back(mDevice, true);
+        mAdvectCmd.back().Record([&, direct, parity](vk::CommandBuffer commandBuffer)
+        {
+            commandBuffer.debugMarkerBeginEXT({"Advect", {{ 0.51f, 0.33f, 0.66f, 1.0f}}});
+
+            auto barrier = [&](Renderer::Texture& texture)
+            {
+                texture.Barrier(commandBuffer,
+                                vk::ImageLayout::eGeneral, vk::AccessFlagBits::eShaderWrite,
+                                vk::ImageLayout::eGeneral, vk::AccessFlagBits::eShaderRead);
+            };
+
+            if (direct)
+            {
+                auto& advected = mFields.front();
+                advected.DirectBound[parity].PushConstant(commandBuffer, 0, mDt);
+                advected.DirectBound[parity].Record(commandBuffer);
+                barrier(advected.Field.mFieldBack);
+                advected.Field.CopyFrom(commandBuffer, advected.Field.mFieldBack);
+
+                commandBuffer.debugMarkerEndEXT();
+                return;
+            }
+
+            // Trace the back-trajectories once for all the fields
+            mAdvectTraceBound[parity].PushConstant(commandBuffer, mDt);
+            mAdvectTraceBound[parity].Record(commandBuffer);
+            mTrace->Barrier(commandBuffer, vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead);
+            if (mMethod != Method::SemiLagrangian)
+            {
+                mAdvectTraceBackBound[parity].PushConstant(commandBuffer, -mDt);
+                mAdvectTraceBackBound[parity].Record(commandBuffer);
+                mTraceBack->Barrier(commandBuffer, vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead);
+            }
+
+            if (mMethod == Method::SemiLagrangian)
+            {
+                for (auto& batch: mFieldBatches)
+                {
+                    batch.Bound.PushConstant(commandBuffer, static_cast<int>(batch.Fields.size()));
+                    batch.Bound.Record(commandBuffer);
+                }
+
+                for (auto& advected: mFields)
+                {
+                    barrier(advected.Field.mFieldBack);
+                    advected.Field.CopyFrom(commandBuffer, advected.Field.mFieldBack);
+                }
+
+                commandBuffer.debugMarkerEndEXT();
+                return;
+            }
+
+            for (auto& advected: mFields)
+            {
+                auto& density = advected.Field;
+
+                advected.ForwardBound.PushConstant(commandBuffer, 0);
+                advected.ForwardBound.Record(commandBuffer);
+                barrier(*advected.Forward);
+
+                advected.BackwardBound.PushConstant(commandBuffer, 0);
+                advected.BackwardBound.Record(commandBuffer);
+                barrier(*advected.Backward);
+
+                int mode = mMethod == Method::MacCormack ? 0 : 1;
+                advected.CorrectBound.PushConstant(commandBuffer, mode);
+                advected.CorrectBound.Record(commandBuffer);
+                barrier(density.mFieldBack);
+
+                if (mMethod == Method::BFECC)
+                {
+                    // Advect the corrected field, limited by the original field
+                    advected.CorrectedBound.PushConstant(commandBuffer, 1);
+                    advected.CorrectedBound.Record(commandBuffer);
+                    barrier(*advected.Forward);
+                    density.CopyFrom(commandBuffer, *advected.Forward);
+                }
+                else
+                {
+                    density.CopyFrom(commandBuffer, density.mFieldBack);
+                }
+            }
+
+            commandBuffer.debugMarkerEndEXT();
+        });
+    }
 }
 
 void Advection::Advect()
 {
-    if (mAdvectCmd)
+    if (!mAdvectCmd.empty())
     {
-        mAdvectCmd.Submit();
+        // The submit resets the fence of the previous advection with this parity
+        auto& advectCmd = mAdvectCmd[mVelocity.GetParity()];
+        advectCmd.Wait();
+        advectCmd.Submit();
     }
 }
 
-void Advection::AdvectParticleBind(Renderer::GenericBuffer& particles,
+void Advection::AdvectParticleBind(Particles& particles,
                                    Renderer::Texture& levelSet,
                                    Renderer::IndirectBuffer<Renderer::DispatchParams>& dispatchParams)
 {
-    mAdvectParticlesBound = mAdvectParticles.Bind(mSize, {particles, dispatchParams, mVelocity, levelSet});
-    mAdvectParticlesCmd.Record([&](vk::CommandBuffer commandBuffer)
+    mParticleCount = nullptr;
+    RetireAdvectParticles();
+    RecordAdvectParticles(particles, levelSet, dispatchParams);
+}
+
+void Advection::AdvectParticleBind(ParticleCount& particleCount,
+                                   Renderer::Texture& levelSet)
+{
+    mParticleCount = &particleCount;
+    RetireAdvectParticles();
+    for (int parity = 0; parity < 2; parity++)
     {
-        commandBuffer.debugMarkerBeginEXT({"Particle advect", {{ 0.09f, 0.17f, 0.36f, 1.0f}}});
-        mAdvectParticlesBound.PushConstant(commandBuffer, mDt);
-        mAdvectParticlesBound.RecordIndirect(commandBuffer, dispatchParams);
-        particles.Barrier(commandBuffer, vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead);
-        commandBuffer.debugMarkerEndEXT();
-    });
+        RecordAdvectParticles(particleCount.GetParticles(parity),
+                              levelSet,
+                              particleCount.GetDispatchParams(parity));
+    }
+}
+
+void Advection::RetireAdvectParticles()
+{
+    // The previous commands could still be executing, they are kept until the next binding.
+    // The particle count only reallocates its buffers once the previous reallocation has completed
+    mRetiredAdvectParticlesBound = std::move(mAdvectParticlesBound);
+    mRetiredAdvectParticlesCmd = std::move(mAdvectParticlesCmd);
+    mAdvectParticlesBound.clear();
+    mAdvectParticlesCmd.clear();
+}
+
+void Advection::RecordAdvectParticles(Particles& particles,
+                                      Renderer::Texture& levelSet,
+                                      Renderer::IndirectBuffer<Renderer::DispatchParams>& dispatchParams)
+{
+    for (int parity = 0; parity < 2; parity++)
+    {
+        auto& velocity = mVelocity.Input(parity);
+        mAdvectParticlesBound.push_back(mAdvectParticles.Bind(mSize, {particles.Position, dispatchParams, velocity, levelSet, {*mSampler, velocity}, particles.Cell}));
+
+        // The bounds are referred to by index, the vector can grow while recording
+        std::size_t index = mAdvectParticlesBound.size() - 1;
+        mAdvectParticlesCmd.emplace_back(mDevice, false);
+        mAdvectParticlesCmd.back().Record([&, index](vk::CommandBuffer commandBuffer)
+        {
+            auto& bound = mAdvectParticlesBound[index];
+            commandBuffer.debugMarkerBeginEXT({"Particle advect", {{ 0.09f, 0.17f, 0.36f, 1.0f}}});
+            bound.PushConstant(commandBuffer, mDt, (int)particles.Compact);
+            bound.RecordIndirect(commandBuffer, dispatchParams);
+            particles.Position.Barrier(commandBuffer, vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead);
+            commandBuffer.debugMarkerEndEXT();
+        });
+    }
 }
 
 void Advection::AdvectParticles()
 {
-    mAdvectParticlesCmd.Submit();
+    // The commands are recorded for each particle buffer, then for each velocity parity
+    int parity = mParticleCount ? mParticleCount->GetParity() : 0;
+    mAdvectParticlesCmd[2 * parity + mVelocity.GetParity()].Submit();
 }
 
 }}
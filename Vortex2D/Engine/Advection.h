@@ -11,6 +11,11 @@
 #include <Vortex2D/Renderer/CommandBuffer.h>
 
 #include <Vortex2D/Engine/Velocity.h>
+#include <Vortex2D/Engine/Particles.h>
+
+#include <memory>
+#include <vector>
+#include <functional>
 
 namespace Vortex2D { namespace Fluid {
 
@@ -22,21 +27,49 @@ class Density;
 class Advection
 {
 public:
+    /**
+     * @brief The advection scheme of the velocity and density fields.
+     */
+    enum class Method
+    {
+        /**
+         * @brief Semi-Lagrangian with a RK3 back trace and bilinear interpolation.
+         */
+        SemiLagrangian,
+        /**
+         * @brief MacCormack: a forward and backward semi-Lagrangian step estimate the error,
+         * which corrects the forward step. The result is limited to the interpolated values.
+         */
+        MacCormack,
+        /**
+         * @brief Back and Forth Error Compensation and Correction: the field is corrected with the
+         * error estimated by a forward and backward step, then advected with a limited semi-Lagrangian step.
+         */
+        BFECC
+    };
+
     /**
      * @brief Initialize advection kernels and related object.
      * @param device vulkan device
      * @param size size of velocity field
      * @param dt delta time for integration
      * @param velocity velocity field
+     * @param method advection scheme used for the velocity and density fields
      */
-    VORTEX2D_API Advection(const Renderer::Device& device, const glm::ivec2& size, float dt, Velocity& velocity);
+    VORTEX2D_API Advection(const Renderer::Device& device,
+                           const glm::ivec2& size,
+                           float dt,
+                           Velocity& velocity,
+                           Method method = Method::SemiLagrangian);
 
     /**
-     * @brief Self advect velocity
+     * @brief Self advect velocity. The advected velocity is written to the output field and the fields are
+     * swapped, see @ref Velocity::Swap.
      */
     VORTEX2D_API void AdvectVelocity();
 
-    // TODO can only advect one field, need to be able to do as many as we want
+    using FieldList = std::initializer_list<std::reference_wrapper<Density>>;
+
     /**
      * @brief Binds a density field to be advected.
      * @param density density field
@@ -44,40 +77,111 @@ public:
     VORTEX2D_API void AdvectBind(Density& density);
 
     /**
-     * @brief Performs an advection of the density field. Asynchronous operation.
+     * @brief Binds several fields to be advected together. The back-trajectories are traced once
+     * and each field is sampled at the traced positions. With the semi-Lagrangian method, fields of
+     * the same format are sampled four at a time in one dispatch, and a single field is traced and sampled
+     * in the same dispatch.
+     * Supported formats are 8 bits RGBA (eR8G8B8A8Unorm, eB8G8R8A8Unorm) and 32 bits float (eR32Sfloat).
+     * @param fields the fields to advect
+     */
+    VORTEX2D_API void AdvectBind(FieldList fields);
+
+    /**
+     * @brief Performs an advection of the bound fields. Asynchronous operation.
      */
     VORTEX2D_API void Advect();
 
     /**
      * @brief Binds praticles to be advected.
      * Also use a level set to project out the particles if they enter it.
-     * @param particles particles to be advected
+     * @param particles particles to be advected, only the positions (and the cells if compact) are used
      * @param levelSet level set to project out particles
      * @param dispatchParams contains number of particles
      */
-    VORTEX2D_API void AdvectParticleBind(Renderer::GenericBuffer& particles,
+    VORTEX2D_API void AdvectParticleBind(Particles& particles,
                                          Renderer::Texture& levelSet,
                                          Renderer::IndirectBuffer<Renderer::DispatchParams>& dispatchParams);
+
+    /**
+     * @brief Binds the double buffered particles of a particle count to be advected.
+     * The particle buffer that is current when @ref AdvectParticles is called is advected.
+     * To be called again when the particle buffers are reallocated, the previous bindings are kept until the next call.
+     * @param particleCount particles to be advected
+     * @param levelSet level set to project out particles
+     */
+    VORTEX2D_API void AdvectParticleBind(ParticleCount& particleCount,
+                                         Renderer::Texture& levelSet);
+
     /**
      * @brief Advect particles. Asynchrounous operation.
      */
     VORTEX2D_API void AdvectParticles();
 
 private:
+    void RetireAdvectParticles();
+    void RecordAdvectParticles(Particles& particles,
+                               Renderer::Texture& levelSet,
+                               Renderer::IndirectBuffer<Renderer::DispatchParams>& dispatchParams);
+
+    enum class FieldKernel
+    {
+        Advect,
+        Correct,
+        Direct,
+        Batch
+    };
+
+    void RecordAdvectVelocity();
+    Renderer::Work& GetFieldWork(vk::Format format, FieldKernel kernel);
+    void BindFieldBatches();
+
+    struct AdvectedField
+    {
+        AdvectedField(Density& field);
+
+        Density& Field;
+        std::unique_ptr<Renderer::Texture> Forward, Backward;
+        std::vector<Renderer::Work::Bound> DirectBound;
+        Renderer::Work::Bound ForwardBound, BackwardBound, CorrectBound, CorrectedBound;
+    };
+
+    struct FieldBatch
+    {
+        Renderer::Work::Bound Bound;
+        std::vector<Density*> Fields;
+    };
+
+    const Renderer::Device& mDevice;
     float mDt;
     glm::ivec2 mSize;
     Velocity& mVelocity;
+    Method mMethod;
+    bool mLinearFilter;
+    vk::UniqueSampler mSampler;
 
     Renderer::Work mVelocityAdvect;
-    Renderer::Work::Bound mVelocityAdvectBound;
-    Renderer::Work mAdvect;
-    Renderer::Work::Bound mAdvectBound;
+    std::vector<Renderer::Work::Bound> mVelocityAdvectBound;
+    Renderer::Work mVelocityCorrect;
+    std::unique_ptr<Renderer::Texture> mVelocityForward;
+    std::vector<Renderer::Work::Bound> mVelocityForwardBound, mVelocityBackwardBound, mVelocityCorrectBound;
+    std::unique_ptr<Renderer::Buffer<glm::vec2>> mTrace, mTraceBack;
+    Renderer::Work mAdvectTrace;
+    std::vector<Renderer::Work::Bound> mAdvectTraceBound, mAdvectTraceBackBound;
+    Renderer::Work mAdvectFieldRgba8, mAdvectFieldR32f;
+    Renderer::Work mAdvectFieldDirectRgba8, mAdvectFieldDirectR32f;
+    Renderer::Work mAdvectFieldsRgba8, mAdvectFieldsR32f;
+    Renderer::Work mAdvectFieldCorrectRgba8, mAdvectFieldCorrectR32f;
+    std::vector<AdvectedField> mFields;
+    std::vector<FieldBatch> mFieldBatches;
     Renderer::Work mAdvectParticles;
-    Renderer::Work::Bound mAdvectParticlesBound;
-
-    Renderer::CommandBuffer mAdvectVelocityCmd;
-    Renderer::CommandBuffer mAdvectCmd;
-    Renderer::CommandBuffer mAdvectParticlesCmd;
+    std::vector<Renderer::Work::Bound> mAdvectParticlesBound;
+
+    std::vector<Renderer::CommandBuffer> mAdvectVelocityCmd;
+    std::vector<Renderer::CommandBuffer> mAdvectCmd;
+    std::vector<Renderer::CommandBuffer> mAdvectParticlesCmd;
+    std::vector<Renderer::Work::Bound> mRetiredAdvectParticlesBound;
+    std::vector<Renderer::CommandBuffer> mRetiredAdvectParticlesCmd;
+    ParticleCount* mParticleCount;
 };
 
 
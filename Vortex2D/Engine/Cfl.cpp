@@ -12,7 +12,7 @@ namespace Vortex2D { namespace Fluid {
 Cfl::Cfl(const Renderer::Device& device, const glm::ivec2& size, Velocity& velocity)
  : mSize(size)
  , mVelocity(velocity)
- , mVelocityMaxWork(device, size, SPIRV::VelocityMax_comp)
+ , mVelocityMaxWork(device, size, velocity.SelectSpirv(SPIRV::VelocityMax_comp, SPIRV::VelocityMaxHalf_comp))
  , mVelocityMax(device, size.x * size.y)
  , mCfl(device, 1, VMA_MEMORY_USAGE_GPU_TO_CPU)
  , mVelocityMaxCmd(device, true)
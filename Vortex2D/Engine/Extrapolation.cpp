@@ -4,69 +4,282 @@
 
 #include "Extrapolation.h"
 
+#include <algorithm>
+
 #include "vortex2d_generated_spirv.h"
 
 namespace Vortex2D { namespace Fluid {
 
+constexpr int Extrapolation::MaxRigidbodies;
+
 Extrapolation::Extrapolation(const Renderer::Device& device,
                              const glm::ivec2& size,
                              Renderer::GenericBuffer& valid,
                              Velocity& velocity,
                              int iterations)
-    : mValid(device,size.x*size.y)
+    : mDevice(device)
+    , mInputValid(valid)
+    , mValid(device,size.x*size.y)
     , mVelocity(velocity)
-    , mExtrapolateVelocity(device, size, SPIRV::ExtrapolateVelocity_comp)
-    , mExtrapolateVelocityBound(mExtrapolateVelocity.Bind({valid, mValid, velocity, velocity.Output()}))
-    , mExtrapolateVelocityBackBound(mExtrapolateVelocity.Bind({mValid, valid, velocity.Output(), velocity}))
-    , mConstrainVelocity(device, size, SPIRV::ConstrainVelocity_comp)
-    , mExtrapolateCmd(device, false)
-    , mConstrainCmd(device, false)
+    , mIterations(iterations)
+    , mMethod(Method::Iterative)
+    , mBandWidth(10.0f)
+    , mLiquidPhiBound(false)
+    , mSolidPhiBound(false)
+    , mRigidbodies(device, MaxRigidbodies)
+    , mRigidbodyIds(device, size.x*size.y)
+    , mNumRigidbodies(0)
+    , mExtrapolateVelocity(device, size, velocity.SelectSpirv(SPIRV::ExtrapolateVelocity_comp, SPIRV::ExtrapolateVelocityHalf_comp))
+    , mLinearFilter(Renderer::IsLinearFilterSupported(device, vk::Format::eR32Sfloat))
+    , mSampler(Renderer::SamplerBuilder()
+               .AddressMode(vk::SamplerAddressMode::eClampToEdge)
+               .Filter(mLinearFilter ? vk::Filter::eLinear : vk::Filter::eNearest)
+               .Create(device.Handle()))
+    , mExtrapolateClosestPoint(device,
+                               size,
+                               velocity.SelectSpirv(SPIRV::ExtrapolateClosestPoint_comp, SPIRV::ExtrapolateClosestPointHalf_comp),
+                               Renderer::SpecConst(Renderer::SpecConstValue(3, mLinearFilter ? 1 : 0)))
+    , mConstrainVelocity(device, size, velocity.SelectSpirv(SPIRV::ConstrainVelocity_comp, SPIRV::ConstrainVelocityHalf_comp))
+    , mExtrapolateConstrain(device, size, velocity.SelectSpirv(SPIRV::ExtrapolateConstrainVelocity_comp, SPIRV::ExtrapolateConstrainVelocityHalf_comp))
 {
-    mExtrapolateCmd.Record([&, iterations](vk::CommandBuffer commandBuffer)
+    // Each pass swaps the velocity fields and the valid buffers,
+    // the passes are bound for the parity of both.
+    for (int velocityParity = 0; velocityParity < 2; velocityParity++)
     {
-        commandBuffer.debugMarkerBeginEXT({"Extrapolate", {{ 0.60f, 0.87f, 0.12f, 1.0f}}});
-        for (int i = 0; i < iterations / 2; i++)
+        for (int validParity = 0; validParity < 2; validParity++)
         {
-            mExtrapolateVelocityBound.Record(commandBuffer);
-            velocity.Output().Barrier(commandBuffer,
-                                      vk::ImageLayout::eGeneral, vk::AccessFlagBits::eShaderWrite,
-                                      vk::ImageLayout::eGeneral, vk::AccessFlagBits::eShaderRead);
-            mValid.Barrier(commandBuffer,
-                           vk::AccessFlagBits::eShaderWrite,
-                           vk::AccessFlagBits::eShaderRead);
-            mExtrapolateVelocityBackBound.Record(commandBuffer);
-            velocity.Barrier(commandBuffer,
-                             vk::ImageLayout::eGeneral, vk::AccessFlagBits::eShaderWrite,
-                             vk::ImageLayout::eGeneral, vk::AccessFlagBits::eShaderRead);
-            valid.Barrier(commandBuffer,
-                          vk::AccessFlagBits::eShaderWrite,
-                          vk::AccessFlagBits::eShaderRead);
+            mExtrapolateVelocityBound.push_back(mExtrapolateVelocity.Bind({OldValid(validParity),
+                                                                           NewValid(validParity),
+                                                                           velocity.Input(velocityParity),
+                                                                           velocity.Output(velocityParity)}));
         }
-        commandBuffer.debugMarkerEndEXT();
-    });
+    }
+
+    RecordExtrapolate();
+}
+
+Renderer::GenericBuffer& Extrapolation::OldValid(int validParity)
+{
+    return validParity == 0 ? mInputValid : mValid;
+}
+
+Renderer::GenericBuffer& Extrapolation::NewValid(int validParity)
+{
+    return validParity == 0 ? mValid : mInputValid;
 }
 
 void Extrapolation::Extrapolate()
 {
-    mExtrapolateCmd.Submit();
+    Submit(mExtrapolateCmd[mVelocity.GetParity()]);
+}
+
+void Extrapolation::Submit(Renderer::CommandBuffer& cmd)
+{
+    // The submit resets the fence of the previous submission of this command
+    cmd.Wait();
+    cmd.Submit();
+}
+
+void Extrapolation::WaitCommands()
+{
+    for (auto* cmds: {&mExtrapolateCmd, &mConstrainCmd, &mExtrapolateConstrainCmd})
+    {
+        for (auto& cmd: *cmds)
+        {
+            cmd.Wait();
+        }
+    }
+}
+
+void Extrapolation::LiquidPhiBind(Renderer::Texture& liquidPhi)
+{
+    // The commands using the previous bindings could still be executing
+    WaitCommands();
+
+    // The closest point pass is always the first one
+    mExtrapolateClosestPointBound.clear();
+    for (int parity = 0; parity < 2; parity++)
+    {
+        mExtrapolateClosestPointBound.push_back(mExtrapolateClosestPoint.Bind({{*mSampler, liquidPhi},
+                                                                               OldValid(0),
+                                                                               NewValid(0),
+                                                                               mVelocity.Input(parity),
+                                                                               mVelocity.Output(parity)}));
+    }
+    mLiquidPhiBound = true;
+
+    if (mMethod == Method::ClosestPoint)
+    {
+        RecordExtrapolate();
+    }
+}
+
+void Extrapolation::SetMethod(Method method, float bandWidth)
+{
+    if (method == Method::ClosestPoint && !mLiquidPhiBound)
+    {
+        throw std::runtime_error("Liquid level set needs to be bound for the closest point extrapolation");
+    }
+
+    // The extrapolate commands could still be executing
+    WaitCommands();
+
+    mMethod = method;
+    mBandWidth = bandWidth;
+    RecordExtrapolate();
+}
+
+int Extrapolation::GetNumPasses(bool swap)
+{
+    if (mMethod == Method::ClosestPoint)
+    {
+        // One closest point pass, followed by sweeps filling the cells it missed
+        return swap ? 3 : 2;
+    }
+
+    int passes = 2 * std::max(1, mIterations / 2);
+    return swap ? passes - 1 : passes;
+}
+
+void Extrapolation::RecordExtrapolate()
+{
+    mExtrapolateCmd.clear();
+    for (int parity = 0; parity < 2; parity++)
+    {
+        mExtrapolateCmd.emplace_back(mDevice, true);
+        mExtrapolateCmd.back().Record([&, parity](vk::CommandBuffer commandBuffer)
+        {
+            commandBuffer.debugMarkerBeginEXT({"Extrapolate", {{ 0.60f, 0.87f, 0.12f, 1.0f}}});
+            RecordExtrapolate(commandBuffer, parity, GetNumPasses(false), false);
+            commandBuffer.debugMarkerEndEXT();
+        });
+    }
+
+    mExtrapolateConstrainCmd.clear();
+    if (mSolidPhiBound)
+    {
+        for (int parity = 0; parity < 2; parity++)
+        {
+            for (bool swap: {false, true})
+            {
+                mExtrapolateConstrainCmd.emplace_back(mDevice, true);
+                mExtrapolateConstrainCmd.back().Record([&, parity, swap](vk::CommandBuffer commandBuffer)
+                {
+                    commandBuffer.debugMarkerBeginEXT({"Extrapolate & Constrain", {{ 0.71f, 0.55f, 0.16f, 1.0f}}});
+                    RecordExtrapolate(commandBuffer, parity, GetNumPasses(swap), true);
+                    mRigidbodyIds.Clear(commandBuffer);
+                    commandBuffer.debugMarkerEndEXT();
+                });
+            }
+        }
+    }
+}
+
+void Extrapolation::RecordExtrapolate(vk::CommandBuffer commandBuffer, int parity, int passes, bool constrain)
+{
+    for (int i = 0; i < passes; i++)
+    {
+        int velocityParity = (parity + i) % 2;
+        int validParity = i % 2;
+        int index = 2 * velocityParity + validParity;
+
+        if (constrain && i == passes - 1)
+        {
+            mExtrapolateConstrainBound[index].Record(commandBuffer);
+        }
+        else if (mMethod == Method::ClosestPoint && i == 0)
+        {
+            mExtrapolateClosestPointBound[velocityParity].PushConstant(commandBuffer, mBandWidth);
+            mExtrapolateClosestPointBound[velocityParity].Record(commandBuffer);
+        }
+        else
+        {
+            mExtrapolateVelocityBound[index].Record(commandBuffer);
+        }
+
+        mVelocity.Output(velocityParity).Barrier(commandBuffer,
+                                                 vk::ImageLayout::eGeneral, vk::AccessFlagBits::eShaderWrite,
+                                                 vk::ImageLayout::eGeneral, vk::AccessFlagBits::eShaderRead);
+        NewValid(validParity).Barrier(commandBuffer,
+                                      vk::AccessFlagBits::eShaderWrite,
+                                      vk::AccessFlagBits::eShaderRead);
+    }
 }
 
 void Extrapolation::ConstrainBind(Renderer::Texture& solidPhi)
 {
-    mConstrainVelocityBound = mConstrainVelocity.Bind({solidPhi, mVelocity, mVelocity.Output()});
+    // The commands using the previous bindings could still be executing
+    WaitCommands();
 
-    mConstrainCmd.Record([&](vk::CommandBuffer commandBuffer)
+    mConstrainVelocityBound.clear();
+    mExtrapolateConstrainBound.clear();
+    for (int velocityParity = 0; velocityParity < 2; velocityParity++)
     {
-        commandBuffer.debugMarkerBeginEXT({"Constrain Velocity", {{ 0.82f, 0.20f, 0.20f, 1.0f}}});
-        mConstrainVelocityBound.Record(commandBuffer);
-        mVelocity.CopyBack(commandBuffer);
-        commandBuffer.debugMarkerEndEXT();
-    });
+        auto& input = mVelocity.Input(velocityParity);
+        auto& output = mVelocity.Output(velocityParity);
+
+        mConstrainVelocityBound.push_back(mConstrainVelocity.Bind({solidPhi, input, output, mRigidbodies, mRigidbodyIds}));
+        for (int validParity = 0; validParity < 2; validParity++)
+        {
+            mExtrapolateConstrainBound.push_back(mExtrapolateConstrain.Bind({OldValid(validParity),
+                                                                             NewValid(validParity),
+                                                                             input,
+                                                                             output,
+                                                                             solidPhi,
+                                                                             mRigidbodies,
+                                                                             mRigidbodyIds}));
+        }
+    }
+    mSolidPhiBound = true;
+
+    mConstrainCmd.clear();
+    for (int parity = 0; parity < 2; parity++)
+    {
+        mConstrainCmd.emplace_back(mDevice, true);
+        mConstrainCmd.back().Record([&, parity](vk::CommandBuffer commandBuffer)
+        {
+            commandBuffer.debugMarkerBeginEXT({"Constrain Velocity", {{ 0.82f, 0.20f, 0.20f, 1.0f}}});
+            mConstrainVelocityBound[parity].Record(commandBuffer);
+            mVelocity.Output(parity).Barrier(commandBuffer,
+                                             vk::ImageLayout::eGeneral, vk::AccessFlagBits::eShaderWrite,
+                                             vk::ImageLayout::eGeneral, vk::AccessFlagBits::eShaderRead);
+            mRigidbodyIds.Clear(commandBuffer);
+            commandBuffer.debugMarkerEndEXT();
+        });
+    }
+
+    RecordExtrapolate();
+}
+
+void Extrapolation::RigidbodyBind(RigidBody& rigidbody,
+                                  Renderer::GenericBuffer& div,
+                                  Renderer::GenericBuffer& diagonal)
+{
+    if (mNumRigidbodies >= MaxRigidbodies) throw std::runtime_error("Too many rigid bodies");
+
+    // The bodies write their index in the cells they cover, the constraint then reads them all in one pass
+    rigidbody.BindDiv(div, diagonal, mRigidbodies, mRigidbodyIds, mNumRigidbodies++);
 }
 
 void Extrapolation::ConstrainVelocity()
 {
-    mConstrainCmd.Submit();
+    // The constrained velocity is in the output field, which becomes the input
+    Submit(mConstrainCmd[mVelocity.GetParity()]);
+    mVelocity.Swap();
+}
+
+void Extrapolation::ExtrapolateConstrain(bool swap)
+{
+    if (!mSolidPhiBound)
+    {
+        throw std::runtime_error("Solid level set needs to be bound to constrain the velocity");
+    }
+
+    Submit(mExtrapolateConstrainCmd[2 * mVelocity.GetParity() + swap]);
+    if (swap)
+    {
+        mVelocity.Swap();
+    }
 }
 
 }}
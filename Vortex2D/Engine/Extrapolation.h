@@ -10,6 +10,9 @@
 #include <Vortex2D/Renderer/Work.h>
 #include <Vortex2D/Engine/LevelSet.h>
 #include <Vortex2D/Engine/Velocity.h>
+#include <Vortex2D/Engine/Rigidbody.h>
+
+#include <vector>
 
 namespace Vortex2D { namespace Fluid {
 
@@ -19,6 +22,22 @@ namespace Vortex2D { namespace Fluid {
 class Extrapolation
 {
 public:
+    /**
+     * @brief How the values are extrapolated.
+     */
+    enum class Method
+    {
+        /**
+         * @brief Fixed number of sweeps over the whole grid, each extending the valid values by one cell.
+         */
+        Iterative,
+        /**
+         * @brief Values are taken at the closest point in the liquid, using the liquid level set.
+         * Only the cells within a band around the liquid are extrapolated.
+         */
+        ClosestPoint
+    };
+
     VORTEX2D_API Extrapolation(const Renderer::Device& device,
                                const glm::ivec2& size,
                                Renderer::GenericBuffer& valid,
@@ -26,10 +45,24 @@ public:
                                int iterations = 10);
 
     /**
-     * @brief Will extrapolate values from buffer into the dirichlet and neumann boundaries
+     * @brief Will extrapolate values from buffer into the dirichlet and neumann boundaries.
+     * The velocity ends in the same field of the ping-pong it started in.
      */
     VORTEX2D_API void Extrapolate();
 
+    /**
+     * @brief Binds the liquid level set used by the closest point method.
+     * @param liquidPhi liquid level set
+     */
+    VORTEX2D_API void LiquidPhiBind(Renderer::Texture& liquidPhi);
+
+    /**
+     * @brief Set the extrapolation method. The closest point method requires the liquid level set to be bound.
+     * @param method the extrapolation method
+     * @param bandWidth width in cells of the band around the liquid extrapolated with the closest point method.
+     */
+    VORTEX2D_API void SetMethod(Method method, float bandWidth = 10.0f);
+
     /**
      * @brief Binds a solid level set to use later and constrain the velocity against
      * @param solidPhi solid level set
@@ -37,21 +70,72 @@ public:
     VORTEX2D_API void ConstrainBind(Renderer::Texture& solidPhi);
 
     /**
-     * @brief Constrain the velocity, i.e. ensure that the velocity normal to the solid level set is 0.
+     * @brief Binds a static rigid body, whose velocity is enforced by the constraint on the faces it covers.
+     * This binds the body's div, which registers the body for the next constraint each time it is run.
+     * @param rigidbody the rigid body, at most @ref MaxRigidbodies
+     * @param div right hand side of the linear system Ax=b
+     * @param diagonal diagonal of matrix A
+     */
+    VORTEX2D_API void RigidbodyBind(RigidBody& rigidbody,
+                                    Renderer::GenericBuffer& div,
+                                    Renderer::GenericBuffer& diagonal);
+
+    /**
+     * @brief Constrain the velocity, i.e. ensure that the velocity normal to the solid level set is
+     * the one of the solid: 0 for static solids, or the velocity of the rigid bodies.
+     * The constrained velocity is written to the output field and the fields are swapped, see @ref Velocity::Swap.
      */
     VORTEX2D_API void ConstrainVelocity();
 
+    /**
+     * @brief Extrapolate and constrain the velocity, with the last extrapolation sweep and the constraint
+     * done in the same pass. Same result as @ref Extrapolate followed by @ref ConstrainVelocity,
+     * without copying back the velocity. Requires the solid level set to be bound.
+     * @param swap end with the velocity in the other field of the ping-pong, see @ref Velocity::Swap.
+     * This saves a copy when the next pass swaps the fields back, e.g. @ref Advection::AdvectVelocity.
+     * The iterative method then does one pass less and the closest point method one more,
+     * and the last valid cells are not written back to the valid buffer.
+     */
+    VORTEX2D_API void ExtrapolateConstrain(bool swap = false);
+
+    static constexpr int MaxRigidbodies = 64;
+
 private:
+    Renderer::GenericBuffer& OldValid(int validParity);
+    Renderer::GenericBuffer& NewValid(int validParity);
+    int GetNumPasses(bool swap);
+    void RecordExtrapolate();
+    void RecordExtrapolate(vk::CommandBuffer commandBuffer, int parity, int passes, bool constrain);
+    void Submit(Renderer::CommandBuffer& cmd);
+    void WaitCommands();
+
+    const Renderer::Device& mDevice;
+    Renderer::GenericBuffer& mInputValid;
     Renderer::Buffer<glm::ivec2> mValid;
     Velocity& mVelocity;
+    int mIterations;
+    Method mMethod;
+    float mBandWidth;
+    bool mLiquidPhiBound;
+    bool mSolidPhiBound;
+    Renderer::Buffer<RigidBody::Constraint> mRigidbodies;
+    Renderer::Buffer<int> mRigidbodyIds;
+    int mNumRigidbodies;
 
     Renderer::Work mExtrapolateVelocity;
-    Renderer::Work::Bound mExtrapolateVelocityBound, mExtrapolateVelocityBackBound;
+    std::vector<Renderer::Work::Bound> mExtrapolateVelocityBound;
+    bool mLinearFilter;
+    vk::UniqueSampler mSampler;
+    Renderer::Work mExtrapolateClosestPoint;
+    std::vector<Renderer::Work::Bound> mExtrapolateClosestPointBound;
     Renderer::Work mConstrainVelocity;
-    Renderer::Work::Bound mConstrainVelocityBound;
+    std::vector<Renderer::Work::Bound> mConstrainVelocityBound;
+    Renderer::Work mExtrapolateConstrain;
+    std::vector<Renderer::Work::Bound> mExtrapolateConstrainBound;
 
-    Renderer::CommandBuffer mExtrapolateCmd;
-    Renderer::CommandBuffer mConstrainCmd;
+    std::vector<Renderer::CommandBuffer> mExtrapolateCmd;
+    std::vector<Renderer::CommandBuffer> mConstrainCmd;
+    std::vector<Renderer::CommandBuffer> mExtrapolateConstrainCmd;
 };
 
 }}
@@ -0,0 +1,67 @@
+//
+//  Forces.cpp
+//  Vortex2D
+//
+
+#include "Forces.h"
+
+#include "vortex2d_generated_spirv.h"
+
+namespace Vortex2D { namespace Fluid {
+
+constexpr int Forces::MaxForces;
+
+Forces::Forces(const Renderer::Device& device, const glm::ivec2& size, float dt, Velocity& velocity)
+    : mDelta(dt)
+    , mVelocity(velocity)
+    , mApplyForcesWork(device, size, velocity.SelectSpirv(SPIRV::ApplyForces_comp, SPIRV::ApplyForcesHalf_comp))
+    , mIndex(0)
+{
+    // Two batches, one being filled while the other one is applied
+    for (int i = 0; i < 2; i++)
+    {
+        mLocalForces.emplace_back(device, MaxForces, VMA_MEMORY_USAGE_CPU_TO_GPU);
+        mApplyForcesBound.push_back(mApplyForcesWork.Bind({velocity, mLocalForces.back()}));
+        mApplyForcesCmds.emplace_back(device, true);
+    }
+}
+
+void Forces::Add(const Force& force)
+{
+    if (mForces.size() >= MaxForces) throw std::runtime_error("Too many forces");
+
+    mForces.push_back(force);
+}
+
+void Forces::Apply()
+{
+    if (mForces.empty())
+    {
+        return;
+    }
+
+    // Wait for the batch previously using these buffers to finish reading them
+    mApplyForcesCmds[mIndex].Wait();
+
+    int count = static_cast<int>(mForces.size());
+    mForces.resize(MaxForces);
+    Renderer::CopyFrom(mLocalForces[mIndex], mForces);
+    mForces.clear();
+
+    auto& bound = mApplyForcesBound[mIndex];
+    mApplyForcesCmds[mIndex].Record([&, count](vk::CommandBuffer commandBuffer)
+    {
+        commandBuffer.debugMarkerBeginEXT({"Apply forces", {{ 0.84f, 0.55f, 0.13f, 1.0f}}});
+        bound.PushConstant(commandBuffer, mDelta, count);
+        bound.Record(commandBuffer);
+        mVelocity.Barrier(commandBuffer,
+                          vk::ImageLayout::eGeneral, vk::AccessFlagBits::eShaderWrite,
+                          vk::ImageLayout::eGeneral, vk::AccessFlagBits::eShaderRead);
+        commandBuffer.debugMarkerEndEXT();
+    });
+    mApplyForcesCmds[mIndex].Submit();
+
+    mIndex = (mIndex + 1) % mApplyForcesCmds.size();
+}
+
+}}
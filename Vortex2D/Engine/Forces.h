@@ -0,0 +1,110 @@
+//
+//  Forces.h
+//  Vortex2D
+//
+
+#ifndef Vortex2d_Forces_h
+#define Vortex2d_Forces_h
+
+#include <Vortex2D/Renderer/Work.h>
+#include <Vortex2D/Renderer/Buffer.h>
+#include <Vortex2D/Renderer/CommandBuffer.h>
+#include <Vortex2D/Engine/Velocity.h>
+
+#include <vector>
+
+namespace Vortex2D { namespace Fluid {
+
+/**
+ * @brief A force added to the velocity, see @ref Forces::Add.
+ * Positions and velocities are in cells, like the colour drawn with @ref World::RecordVelocity.
+ */
+struct Force
+{
+    enum class Kind : int32_t
+    {
+        /**
+         * @brief The velocity Value is added once, with a smooth falloff to 0 at the Radius.
+         */
+        Impulse = 0,
+
+        /**
+         * @brief The acceleration Value is applied inside the Radius, or everywhere if the radius is 0.
+         */
+        Directional = 1,
+
+        /**
+         * @brief The acceleration Value.x is applied away from the Position (towards it if negative),
+         * with a smooth falloff to 0 at the Radius.
+         */
+        Radial = 2
+    };
+
+    /**
+     * @brief The centre of the force.
+     */
+    glm::vec2 Position;
+
+    /**
+     * @brief The velocity or acceleration, see @ref Kind.
+     */
+    glm::vec2 Value;
+
+    /**
+     * @brief The radius of the area covered by the force.
+     */
+    float Radius;
+
+    Kind Type;
+};
+
+/**
+ * @brief A batch of forces applied to the velocity field in a single dispatch.
+ * The forces are written to a ring of host visible buffers read directly by the compute shader,
+ * so adding forces never waits for the previous batches to complete.
+ */
+class Forces
+{
+public:
+    /**
+     * @brief Construct the batch of forces.
+     * @param device vulkan device
+     * @param size size of the velocity field
+     * @param dt time step the accelerations are integrated over
+     * @param velocity the velocity field
+     */
+    VORTEX2D_API Forces(const Renderer::Device& device, const glm::ivec2& size, float dt, Velocity& velocity);
+
+    /**
+     * @brief Add a force to the next batch.
+     * @param force the force, a batch has at most @ref MaxForces
+     */
+    VORTEX2D_API void Add(const Force& force);
+
+    /**
+     * @brief Apply the forces added since the last call and start a new batch. Does nothing without forces.
+     */
+    VORTEX2D_API void Apply();
+
+    /**
+     * @brief The maximum number of forces in one batch.
+     */
+    static constexpr int MaxForces = 256;
+
+private:
+    float mDelta;
+    Velocity& mVelocity;
+    Renderer::Work mApplyForcesWork;
+
+    std::vector<Force> mForces;
+
+    // Ring of host buffers with their bound work and command buffer
+    std::vector<Renderer::Buffer<Force>> mLocalForces;
+    std::vector<Renderer::Work::Bound> mApplyForcesBound;
+    std::vector<Renderer::CommandBuffer> mApplyForcesCmds;
+    std::size_t mIndex;
+};
+
+}}
+
+#endif
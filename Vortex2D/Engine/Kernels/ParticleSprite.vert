@@ -0,0 +1,36 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+out gl_PerVertex
+{
+    vec4 gl_Position;
+};
+
+layout(push_constant) uniform Consts
+{
+  float size;
+}consts;
+
+layout(set = 0, binding = 0) uniform UBO
+{
+    mat4 mvp;
+} u;
+
+layout(std430, binding = 2) readonly buffer Visible
+{
+  vec2 value[];
+}visible;
+
+const vec2 corners[6] = vec2[](vec2(-0.5, -0.5),
+                               vec2(0.5, -0.5),
+                               vec2(-0.5, 0.5),
+                               vec2(0.5, -0.5),
+                               vec2(0.5, 0.5),
+                               vec2(-0.5, 0.5));
+
+// One quad per visible particle, the position is read from the storage buffer
+void main()
+{
+    vec2 position = visible.value[gl_InstanceIndex] + consts.size * corners[gl_VertexIndex];
+    gl_Position = u.mvp * vec4(position, 0.0, 1.0);
+}
@@ -8,12 +8,93 @@
 #include <Vortex2D/Engine/Boundaries.h>
 #include <Vortex2D/Renderer/CommandBuffer.h>
 
+#include <algorithm>
+
 #include "vortex2d_generated_spirv.h"
 
 namespace Vortex2D { namespace  Fluid {
 
-LevelSet::LevelSet(const Renderer::Device& device, const glm::ivec2& size, int reinitializeIterations)
+LevelSet::NarrowBand::NarrowBand(const Renderer::Device& device, LevelSet& levelSet)
+    : Mask(device, levelSet.mSize.x*levelSet.mSize.y)
+    , Index(device, levelSet.mSize.x*levelSet.mSize.y)
+    , Cells(device, levelSet.mSize.x*levelSet.mSize.y)
+    , DispatchParams(device)
+    , Band(device, levelSet.mSize, SPIRV::LevelSetBand_comp)
+    , BandBound(Band.Bind({levelSet, Mask}))
+    , Scan(device, levelSet.mSize)
+    , ScanBound(Scan.Bind(Mask, Index, DispatchParams))
+    , Compact(device, levelSet.mSize, SPIRV::LevelSetBandCompact_comp)
+    , CompactBound(Compact.Bind({Mask, Index, Cells}))
+    , Redistance(device, Renderer::ComputeSize::Default1D(), SPIRV::RedistanceBand_comp)
+    , RedistanceFront(Redistance.Bind(levelSet.mSize, {{*levelSet.mSampler, levelSet.mLevelSet0},
+                                                       {*levelSet.mSampler, levelSet},
+                                                       levelSet.mLevelSetBack,
+                                                       Cells,
+                                                       DispatchParams}))
+    , RedistanceBack(Redistance.Bind(levelSet.mSize, {{*levelSet.mSampler, levelSet.mLevelSet0},
+                                                      {*levelSet.mSampler, levelSet.mLevelSetBack},
+                                                      levelSet,
+                                                      Cells,
+                                                      DispatchParams}))
+{
+}
+
+LevelSet::ConvergenceCheck::ConvergenceCheck(const Renderer::Device& device, LevelSet& levelSet)
+    : Error(device, levelSet.mSize.x*levelSet.mSize.y)
+    , MaxError(device, 1)
+    , Max(device, levelSet.mSize)
+    , MaxBound(Max.Bind(Error, MaxError))
+    , RedistanceError(device, levelSet.mSize, SPIRV::RedistanceError_comp)
+    , RedistanceErrorBound(RedistanceError.Bind({{*levelSet.mSampler, levelSet.mLevelSet0},
+                                                 {*levelSet.mSampler, levelSet},
+                                                 Error}))
+    , FullParams(device)
+    , Params(device)
+    , ConvergedIteration(device, 1, VMA_MEMORY_USAGE_GPU_TO_CPU)
+    , Check(device, Renderer::ComputeSize::Default1D(), SPIRV::RedistanceCheck_comp)
+    , CheckFull(Check.Bind({MaxError, FullParams, Params, ConvergedIteration}))
+{
+    // Dispatch parameters of the redistance over the whole level set
+    Renderer::DispatchParams params(0);
+    glm::ivec2 workSize = Renderer::ComputeSize::GetWorkSize(levelSet.mSize);
+    params.workSize.x = workSize.x;
+    params.workSize.y = workSize.y;
+    params.count = levelSet.mSize.x * levelSet.mSize.y;
+
+    Renderer::Buffer<Renderer::DispatchParams> localParams(device, 1, VMA_MEMORY_USAGE_CPU_ONLY);
+    Renderer::CopyFrom(localParams, params);
+    Renderer::ExecuteCommand(device, [&](vk::CommandBuffer commandBuffer)
+    {
+        FullParams.CopyFrom(commandBuffer, localParams);
+    });
+}
+
+LevelSet::JumpFlood::JumpFlood(const Renderer::Device& device, LevelSet& levelSet)
+    : Seeds(device, levelSet.mSize.x*levelSet.mSize.y)
+    , SeedsBack(device, levelSet.mSize.x*levelSet.mSize.y)
+    , Init(device, levelSet.mSize, SPIRV::JumpFloodInit_comp)
+    , InitBound(Init.Bind({levelSet.mLevelSet0, Seeds}))
+    , Flood(device, levelSet.mSize, SPIRV::JumpFlood_comp)
+    , FloodFront(Flood.Bind({Seeds, SeedsBack}))
+    , FloodBack(Flood.Bind({SeedsBack, Seeds}))
+    , Distance(device, levelSet.mSize, SPIRV::JumpFloodDistance_comp)
+    , DistanceFront(Distance.Bind({levelSet.mLevelSet0, Seeds, levelSet}))
+    , DistanceBack(Distance.Bind({levelSet.mLevelSet0, SeedsBack, levelSet}))
+{
+}
+
+LevelSet::LevelSet(const Renderer::Device& device,
+                   const glm::ivec2& size,
+                   int reinitializeIterations,
+                   RedistanceMethod method)
     : Renderer::RenderTexture(device, size.x, size.y, vk::Format::eR32Sfloat)
+    , mDevice(device)
+    , mSize(size)
+    , mReinitializeIterations(reinitializeIterations)
+    , mMethod(method)
+    , mBandWidth(0.0f)
+    , mErrorTolerance(0.0f)
+    , mCheckInterval(10)
     , mLevelSet0(device, size.x, size.y, vk::Format::eR32Sfloat)
     , mLevelSetBack(device, size.x, size.y, vk::Format::eR32Sfloat)
     , mSampler(Renderer::SamplerBuilder()
@@ -24,36 +105,251 @@ LevelSet::LevelSet(const Renderer::Device& device, const glm::ivec2& size, int r
     , mRedistanceFront(mRedistance.Bind({{*mSampler, mLevelSet0}, {*mSampler, *this}, mLevelSetBack}))
     , mRedistanceBack(mRedistance.Bind({{*mSampler, mLevelSet0}, {*mSampler, mLevelSetBack}, *this}))
     , mExtrapolateCmd(device, false)
-    , mReinitialiseCmd(device, false)
+    , mReinitialiseCmd(device, true)
+{
+    if (mMethod == RedistanceMethod::JumpFlooding)
+    {
+        mJumpFlood = std::make_unique<JumpFlood>(device, *this);
+    }
+
+    RecordReinitialise();
+}
+
+void LevelSet::SetRedistanceMethod(RedistanceMethod method)
+{
+    if (method == mMethod)
+    {
+        return;
+    }
+
+    // The reinitialise command could still be executing
+    mReinitialiseCmd.Wait();
+
+    mMethod = method;
+    if (mMethod == RedistanceMethod::JumpFlooding && !mJumpFlood)
+    {
+        mJumpFlood = std::make_unique<JumpFlood>(mDevice, *this);
+    }
+
+    RecordReinitialise();
+}
+
+void LevelSet::SetNarrowBand(float bandWidth)
+{
+    if (bandWidth == mBandWidth)
+    {
+        return;
+    }
+
+    // The reinitialise command could still be executing
+    mReinitialiseCmd.Wait();
+
+    mBandWidth = bandWidth;
+    if (mBandWidth > 0.0f && !mNarrowBand)
+    {
+        mNarrowBand = std::make_unique<NarrowBand>(mDevice, *this);
+        if (mConvergenceCheck)
+        {
+            auto& check = *mConvergenceCheck;
+            check.CheckBand = check.Check.Bind({check.MaxError, mNarrowBand->DispatchParams, check.Params, check.ConvergedIteration});
+        }
+    }
+
+    RecordReinitialise();
+}
+
+void LevelSet::SetConvergenceCheck(float errorTolerance, int checkInterval)
+{
+    if (errorTolerance == mErrorTolerance && checkInterval == mCheckInterval)
+    {
+        return;
+    }
+
+    // The reinitialise command could still be executing
+    mReinitialiseCmd.Wait();
+
+    mErrorTolerance = errorTolerance;
+    mCheckInterval = std::max(1, checkInterval);
+    if (mErrorTolerance > 0.0f && !mConvergenceCheck)
+    {
+        mConvergenceCheck = std::make_unique<ConvergenceCheck>(mDevice, *this);
+        if (mNarrowBand)
+        {
+            auto& check = *mConvergenceCheck;
+            check.CheckBand = check.Check.Bind({check.MaxError, mNarrowBand->DispatchParams, check.Params, check.ConvergedIteration});
+        }
+    }
+
+    RecordReinitialise();
+}
+
+int LevelSet::GetConvergedIterations()
 {
-    mReinitialiseCmd.Record([&, reinitializeIterations](vk::CommandBuffer commandBuffer)
+    int iteration = 0;
+    if (mConvergenceCheck)
+    {
+        Renderer::CopyTo(mConvergenceCheck->ConvergedIteration, iteration);
+    }
+    return iteration == 0 ? mReinitializeIterations / 2 : iteration;
+}
+
+void LevelSet::RecordReinitialise()
+{
+    mReinitialiseCmd.Record([&](vk::CommandBuffer commandBuffer)
     {
         commandBuffer.debugMarkerBeginEXT({"Reinitialise", {{ 0.98f, 0.49f, 0.26f, 1.0f}}});
 
         mLevelSet0.CopyFrom(commandBuffer, *this);
 
-        for (int i = 0; i < reinitializeIterations / 2; i++)
+        if (mMethod == RedistanceMethod::JumpFlooding)
         {
-            mRedistanceFront.PushConstant(commandBuffer, 0.1f);
-            mRedistanceFront.Record(commandBuffer);
-            mLevelSetBack.Barrier(commandBuffer,
-                                  vk::ImageLayout::eGeneral,
-                                  vk::AccessFlagBits::eShaderWrite,
-                                  vk::ImageLayout::eGeneral,
-                                  vk::AccessFlagBits::eShaderRead);
-            mRedistanceBack.PushConstant(commandBuffer, 0.1f);
-            mRedistanceBack.Record(commandBuffer);
+            auto& jumpFlood = *mJumpFlood;
+            jumpFlood.InitBound.Record(commandBuffer);
+            jumpFlood.Seeds.Barrier(commandBuffer, vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead);
+
+            // Steps from half the size down to 1, followed by an extra step of 1 to correct the remaining errors
+            std::vector<int> steps;
+            for (int step = 1; step < std::max(mSize.x, mSize.y); step *= 2)
+            {
+                steps.insert(steps.begin(), step);
+            }
+            steps.push_back(1);
+
+            bool front = true;
+            for (int step: steps)
+            {
+                auto& bound = front ? jumpFlood.FloodFront : jumpFlood.FloodBack;
+                auto& output = front ? jumpFlood.SeedsBack : jumpFlood.Seeds;
+
+                bound.PushConstant(commandBuffer, step);
+                bound.Record(commandBuffer);
+                output.Barrier(commandBuffer, vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead);
+
+                front = !front;
+            }
+
+            auto& distance = front ? jumpFlood.DistanceFront : jumpFlood.DistanceBack;
+            distance.Record(commandBuffer);
             Barrier(commandBuffer,
                     vk::ImageLayout::eGeneral,
                     vk::AccessFlagBits::eShaderWrite,
                     vk::ImageLayout::eGeneral,
                     vk::AccessFlagBits::eShaderRead);
         }
+        else
+        {
+            bool narrowBand = mBandWidth > 0.0f;
+            if (narrowBand)
+            {
+                RecordBand(commandBuffer);
+            }
+
+            // With the convergence check, the iterations are dispatched indirectly with
+            // parameters emptied once the error is small enough
+            bool convergenceCheck = mErrorTolerance > 0.0f;
+            if (convergenceCheck)
+            {
+                auto& check = *mConvergenceCheck;
+                auto& fullParams = narrowBand ? mNarrowBand->DispatchParams : check.FullParams;
+                check.Params.CopyFrom(commandBuffer, fullParams);
+                check.Params.Barrier(commandBuffer, vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eIndirectCommandRead);
+                check.ConvergedIteration.Clear(commandBuffer);
+                check.ConvergedIteration.Barrier(commandBuffer, vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite);
+            }
+
+            auto redistance = [&](Renderer::Work::Bound& bound, bool front)
+            {
+                if (narrowBand)
+                {
+                    auto& bandBound = front ? mNarrowBand->RedistanceFront : mNarrowBand->RedistanceBack;
+                    auto& params = convergenceCheck ? mConvergenceCheck->Params : mNarrowBand->DispatchParams;
+                    bandBound.PushConstant(commandBuffer, 0.1f);
+                    bandBound.RecordIndirect(commandBuffer, params);
+                }
+                else if (convergenceCheck)
+                {
+                    bound.PushConstant(commandBuffer, 0.1f);
+                    bound.RecordIndirect(commandBuffer, mConvergenceCheck->Params);
+                }
+                else
+                {
+                    bound.PushConstant(commandBuffer, 0.1f);
+                    bound.Record(commandBuffer);
+                }
+            };
+
+            int iterations = mReinitializeIterations / 2;
+            for (int i = 0; i < iterations; i++)
+            {
+                redistance(mRedistanceFront, true);
+                mLevelSetBack.Barrier(commandBuffer,
+                                      vk::ImageLayout::eGeneral,
+                                      vk::AccessFlagBits::eShaderWrite,
+                                      vk::ImageLayout::eGeneral,
+                                      vk::AccessFlagBits::eShaderRead);
+                redistance(mRedistanceBack, false);
+                Barrier(commandBuffer,
+                        vk::ImageLayout::eGeneral,
+                        vk::AccessFlagBits::eShaderWrite,
+                        vk::ImageLayout::eGeneral,
+                        vk::AccessFlagBits::eShaderRead);
+
+                if (convergenceCheck && (i + 1) % mCheckInterval == 0 && i + 1 < iterations)
+                {
+                    RecordConvergenceCheck(commandBuffer, i + 1);
+                }
+            }
+        }
 
         commandBuffer.debugMarkerEndEXT();
     });
 }
 
+void LevelSet::RecordBand(vk::CommandBuffer commandBuffer)
+{
+    auto& band = *mNarrowBand;
+
+    // Clamp the values outside the band, then compact the cells of the band
+    band.BandBound.PushConstant(commandBuffer, mBandWidth);
+    band.BandBound.Record(commandBuffer);
+    Barrier(commandBuffer,
+            vk::ImageLayout::eGeneral,
+            vk::AccessFlagBits::eShaderWrite,
+            vk::ImageLayout::eGeneral,
+            vk::AccessFlagBits::eShaderRead);
+    band.Mask.Barrier(commandBuffer, vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead);
+    band.ScanBound.Record(commandBuffer);
+    band.Index.Barrier(commandBuffer, vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead);
+    band.CompactBound.Record(commandBuffer);
+    band.Cells.Barrier(commandBuffer, vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead);
+    // Read by the indirect dispatches, and copied by the convergence check
+    band.DispatchParams.Barrier(commandBuffer,
+                                vk::AccessFlagBits::eShaderWrite,
+                                vk::AccessFlagBits::eIndirectCommandRead | vk::AccessFlagBits::eTransferRead);
+
+    // Only the cells of the band are written, so both level sets need the clamped values
+    mLevelSet0.CopyFrom(commandBuffer, *this);
+    mLevelSetBack.CopyFrom(commandBuffer, *this);
+}
+
+void LevelSet::RecordConvergenceCheck(vk::CommandBuffer commandBuffer, int iteration)
+{
+    auto& check = *mConvergenceCheck;
+
+    check.RedistanceErrorBound.PushConstant(commandBuffer, 0.1f, mBandWidth);
+    check.RedistanceErrorBound.Record(commandBuffer);
+    check.Error.Barrier(commandBuffer, vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead);
+    check.MaxBound.Record(commandBuffer);
+    check.MaxError.Barrier(commandBuffer, vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead);
+
+    auto& checkBound = mBandWidth > 0.0f ? check.CheckBand : check.CheckFull;
+    check.Params.Barrier(commandBuffer, vk::AccessFlagBits::eIndirectCommandRead, vk::AccessFlagBits::eShaderWrite);
+    checkBound.PushConstant(commandBuffer, mErrorTolerance, iteration);
+    checkBound.Record(commandBuffer);
+    check.Params.Barrier(commandBuffer, vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eIndirectCommandRead);
+    check.ConvergedIteration.Barrier(commandBuffer, vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eHostRead);
+}
+
 void LevelSet::ExtrapolateBind(Renderer::Texture& solidPhi)
 {
     mExtrapolateBound = mExtrapolate.Bind({solidPhi, *this});
@@ -77,6 +373,8 @@ void LevelSet::ExtrapolateRecord(vk::CommandBuffer commandBuffer)
 
 void LevelSet::Reinitialise()
 {
+    // The submit resets the fence of the previous reinitialisation
+    mReinitialiseCmd.Wait();
     mReinitialiseCmd.Submit();
 }
 
@@ -7,18 +7,75 @@
 #define LevelSet_h
 
 #include <Vortex2D/Renderer/RenderTexture.h>
+#include <Vortex2D/Renderer/Buffer.h>
 #include <Vortex2D/Renderer/Work.h>
 #include <Vortex2D/Renderer/CommandBuffer.h>
+#include <Vortex2D/Engine/PrefixScan.h>
+#include <Vortex2D/Engine/LinearSolver/Reduce.h>
+
+#include <memory>
 
 namespace Vortex2D { namespace Fluid {
 
 /**
  * @brief A signed distance field, which can be re-initialized. In other words, a level set.
+ * The buffers and kernels of the jump flooding, narrow band and convergence check are only
+ * created the first time they are enabled.
  */
 class LevelSet : public Renderer::RenderTexture
 {
 public:
-    VORTEX2D_API LevelSet(const Renderer::Device& device, const glm::ivec2& size, int reinitializeIterations = 100);
+    /**
+     * @brief The algorithm used to reinitialise the level set.
+     */
+    enum class RedistanceMethod
+    {
+        /**
+         * @brief Pseudo-time iterations of the Godunov scheme, the number of iterations is given at construction.
+         */
+        Iterative,
+
+        /**
+         * @brief Jump flooding from the interface, which takes log2 of the size passes.
+         */
+        JumpFlooding,
+    };
+
+    VORTEX2D_API LevelSet(const Renderer::Device& device,
+                          const glm::ivec2& size,
+                          int reinitializeIterations = 100,
+                          RedistanceMethod method = RedistanceMethod::Iterative);
+
+    /**
+     * @brief Select the algorithm used by @ref Reinitialise.
+     * @param method
+     */
+    VORTEX2D_API void SetRedistanceMethod(RedistanceMethod method);
+
+    /**
+     * @brief Restrict the iterative reinitialisation to a narrow band around the interface.
+     * Each reinitialisation builds a compacted list of the cells closer than the band width
+     * to the interface and only updates those. The values of the other cells are clamped to the band width.
+     * @param bandWidth the width of the band in cells, or 0 to process the whole level set (default).
+     */
+    VORTEX2D_API void SetNarrowBand(float bandWidth);
+
+    /**
+     * @brief Stop the iterative reinitialisation early once the level set is a signed distance field.
+     * Every few iterations, the maximum of ||grad phi| - 1| is computed (in the narrow band if used)
+     * and the remaining iterations are dispatched indirectly with no work if it is below the tolerance.
+     * This is done on the GPU, without waiting on the CPU.
+     * @param errorTolerance the maximum error to stop, or 0 to always run all the iterations (default).
+     * @param checkInterval the number of iterations (pairs of passes) between checks.
+     */
+    VORTEX2D_API void SetConvergenceCheck(float errorTolerance, int checkInterval = 10);
+
+    /**
+     * @brief Number of iterations (pairs of passes) run by the last reinitialisation with a convergence check.
+     * This reads back from the GPU, so the reinitialisation needs to have completed.
+     * @return the iterations that dispatched work, at most half the number given at construction.
+     */
+    VORTEX2D_API int GetConvergedIterations();
 
     /**
      * @brief Bind a solid level set, which will be used to extrapolate into this level set
@@ -44,6 +101,64 @@ public:
     void ExtrapolateRecord(vk::CommandBuffer commandBuffer);
 
 private:
+    // The resources of the optional reinitialisations are only created once enabled
+    struct NarrowBand
+    {
+        NarrowBand(const Renderer::Device& device, LevelSet& levelSet);
+
+        Renderer::Buffer<int> Mask, Index;
+        Renderer::Buffer<glm::ivec2> Cells;
+        Renderer::IndirectBuffer<Renderer::DispatchParams> DispatchParams;
+        Renderer::Work Band;
+        Renderer::Work::Bound BandBound;
+        PrefixScan Scan;
+        PrefixScan::Bound ScanBound;
+        Renderer::Work Compact;
+        Renderer::Work::Bound CompactBound;
+        Renderer::Work Redistance;
+        Renderer::Work::Bound RedistanceFront, RedistanceBack;
+    };
+
+    struct ConvergenceCheck
+    {
+        ConvergenceCheck(const Renderer::Device& device, LevelSet& levelSet);
+
+        Renderer::Buffer<float> Error, MaxError;
+        ReduceMax Max;
+        Reduce::Bound MaxBound;
+        Renderer::Work RedistanceError;
+        Renderer::Work::Bound RedistanceErrorBound;
+        Renderer::IndirectBuffer<Renderer::DispatchParams> FullParams, Params;
+        Renderer::Buffer<int> ConvergedIteration;
+        Renderer::Work Check;
+        Renderer::Work::Bound CheckFull, CheckBand;
+    };
+
+    struct JumpFlood
+    {
+        JumpFlood(const Renderer::Device& device, LevelSet& levelSet);
+
+        Renderer::Buffer<glm::vec2> Seeds, SeedsBack;
+        Renderer::Work Init;
+        Renderer::Work::Bound InitBound;
+        Renderer::Work Flood;
+        Renderer::Work::Bound FloodFront, FloodBack;
+        Renderer::Work Distance;
+        Renderer::Work::Bound DistanceFront, DistanceBack;
+    };
+
+    void RecordReinitialise();
+    void RecordBand(vk::CommandBuffer commandBuffer);
+    void RecordConvergenceCheck(vk::CommandBuffer commandBuffer, int iteration);
+
+    const Renderer::Device& mDevice;
+    glm::ivec2 mSize;
+    int mReinitializeIterations;
+    RedistanceMethod mMethod;
+    float mBandWidth;
+    float mErrorTolerance;
+    int mCheckInterval;
+
     Renderer::Texture mLevelSet0;
     Renderer::Texture mLevelSetBack;
 
@@ -55,6 +170,10 @@ private:
     Renderer::Work::Bound mRedistanceFront;
     Renderer::Work::Bound mRedistanceBack;
 
+    std::unique_ptr<NarrowBand> mNarrowBand;
+    std::unique_ptr<ConvergenceCheck> mConvergenceCheck;
+    std::unique_ptr<JumpFlood> mJumpFlood;
+
     Renderer::CommandBuffer mExtrapolateCmd;
     Renderer::CommandBuffer mReinitialiseCmd;
 };
@@ -26,7 +26,7 @@ ConjugateGradient::ConjugateGradient(const Renderer::Device& device,
     , sigma(device, 1)
     , error(device)
     , localError(device, 1, VMA_MEMORY_USAGE_GPU_TO_CPU)
-    , matrixMultiply(device, size, SPIRV::MultiplyMatrix_comp)
+    , matrixMultiply(device, Renderer::MakeStencilComputeSize(size, 1), SPIRV::MultiplyMatrix_comp)
     , scalarDivision(device, glm::ivec2(1), SPIRV::Divide_comp)
     , scalarMultiply(device, size, SPIRV::Multiply_comp)
     , multiplyAdd(device, size, SPIRV::MultiplyAdd_comp)
@@ -46,6 +46,7 @@ ConjugateGradient::ConjugateGradient(const Renderer::Device& device,
     , mSolveInit(device, false)
     , mSolve(device, false)
     , mErrorRead(device)
+    , mTelemetry(nullptr)
 {
 
     mErrorRead.Record([&](vk::CommandBuffer commandBuffer)
@@ -154,10 +155,25 @@ void ConjugateGradient::BindRigidbody(Renderer::GenericBuffer& d,
   rigidBody.BindPressure(d, s, z);
 }
 
+void ConjugateGradient::BindTelemetry(Telemetry* telemetry)
+{
+    mTelemetry = telemetry;
+    if (mTelemetry)
+    {
+        mTelemetry->Bind(error);
+    }
+}
+
 void ConjugateGradient::Solve(Parameters& params, const std::vector<RigidBody*>& rigidbodies)
 {
     mSolveInit.Submit();
 
+    if (mTelemetry)
+    {
+        mTelemetry->Reset();
+        mTelemetry->Append();
+    }
+
     if (params.Type == Parameters::SolverType::Iterative)
     {
         mErrorRead.Submit();
@@ -166,6 +182,11 @@ void ConjugateGradient::Solve(Parameters& params, const std::vector<RigidBody*>&
         Renderer::CopyTo(localError, params.OutError);
         if (params.OutError <= params.ErrorTolerance)
         {
+            if (mTelemetry)
+            {
+                mTelemetry->Submit();
+            }
+
             return;
         }
 
@@ -185,6 +206,11 @@ void ConjugateGradient::Solve(Parameters& params, const std::vector<RigidBody*>&
 
         mSolve.Submit();
 
+        if (mTelemetry)
+        {
+            mTelemetry->Append();
+        }
+
         if (params.Type == Parameters::SolverType::Iterative)
         {
             mErrorRead.Wait();
@@ -192,6 +218,11 @@ void ConjugateGradient::Solve(Parameters& params, const std::vector<RigidBody*>&
             mErrorRead.Submit();
         }
     }
+
+    if (mTelemetry)
+    {
+        mTelemetry->Submit();
+    }
 }
 
 }}
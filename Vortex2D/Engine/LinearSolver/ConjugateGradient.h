@@ -9,6 +9,7 @@
 #include <Vortex2D/Engine/LinearSolver/LinearSolver.h>
 #include <Vortex2D/Engine/LinearSolver/Preconditioner.h>
 #include <Vortex2D/Engine/LinearSolver/Reduce.h>
+#include <Vortex2D/Engine/LinearSolver/Telemetry.h>
 #include <Vortex2D/Renderer/Work.h>
 #include <Vortex2D/Renderer/CommandBuffer.h>
 #include <Vortex2D/Renderer/Timer.h>
@@ -41,6 +42,13 @@ public:
      */
     VORTEX2D_API void Solve(Parameters& params, const std::vector<RigidBody*>& rigidbodies = {}) override;
 
+    /**
+     * @brief Record the residual of each iteration in the telemetry. The residuals
+     * stay on the GPU during the solve and are read back asynchronously.
+     * @param telemetry the telemetry to record into, or nullptr to disable.
+     */
+    VORTEX2D_API void BindTelemetry(Telemetry* telemetry);
+
 private:
     Preconditioner& mPreconditioner;
 
@@ -60,6 +68,8 @@ private:
 
     Renderer::CommandBuffer mSolveInit, mSolve;
     Renderer::CommandBuffer mErrorRead;
+
+    Telemetry* mTelemetry;
 };
 
 }}
@@ -19,7 +19,7 @@ GaussSeidel::GaussSeidel(const Renderer::Device& device, const glm::ivec2& size)
     , mError(device)
     , mLocalError(device, 1, VMA_MEMORY_USAGE_GPU_TO_CPU)
     , mGaussSeidel(device, Renderer::MakeCheckerboardComputeSize(size), SPIRV::GaussSeidel_comp)
-    , mResidualWork(device, size, SPIRV::Residual_comp)
+    , mResidualWork(device, Renderer::MakeStencilComputeSize(size, 1), SPIRV::Residual_comp)
     , mReduceMax(device, size)
     , mReduceMaxBound(mReduceMax.Bind(mResidual, mError))
     , mGaussSeidelCmd(device, false)
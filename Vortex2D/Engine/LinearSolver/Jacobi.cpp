@@ -16,7 +16,7 @@ Jacobi::Jacobi(const Renderer::Device& device, const glm::ivec2& size)
   : mW(1.0f)
   , mPreconditionerIterations(1)
   , mBackPressure(device, size.x * size.y)
-  , mJacobi(device, size, SPIRV::DampedJacobi_comp)
+  , mJacobi(device, Renderer::MakeStencilComputeSize(size, 1), SPIRV::DampedJacobi_comp)
 {
 }
 
@@ -40,7 +40,6 @@ glm::ivec2 Depth::GetDepthSize(std::size_t i) const
 Multigrid::Multigrid(const Renderer::Device& device, const glm::ivec2& size, float delta)
     : mDepth(size)
     , mDelta(delta)
-    , mResidualWork(device, size, SPIRV::Residual_comp)
     , mTransfer(device)
     , mPhiScaleWork(device, size, SPIRV::PhiScale_comp)
     , mSmoother(device, mDepth.GetDepthSize(mDepth.GetMaxDepth()))
@@ -58,7 +57,6 @@ Multigrid::Multigrid(const Renderer::Device& device, const glm::ivec2& size, flo
     for (int i = 0; i < mDepth.GetMaxDepth(); i++)
     {
         auto s = mDepth.GetDepthSize(i);
-        mResiduals.emplace_back(device, s.x*s.y);
         mSmoothers.emplace_back(device, s);
     }
 
@@ -67,7 +65,6 @@ Multigrid::Multigrid(const Renderer::Device& device, const glm::ivec2& size, flo
                    mDatas[depth].Lower,
                    mDatas[depth].B,
                    mDatas[depth].X);
-    mResidualWorkBound.resize(mDepth.GetMaxDepth() + 1);
 }
 
 void Multigrid::Bind(Renderer::GenericBuffer& d,
@@ -78,12 +75,10 @@ void Multigrid::Bind(Renderer::GenericBuffer& d,
 {
     mPressure = &pressure;
 
-    mResidualWorkBound[0] =
-                mResidualWork.Bind({pressure, d, l, b, mResiduals[0]});
+    auto s = mDepth.GetDepthSize(0);
+    mTransfer.ResidualRestrictBind(0, s, pressure, d, l, b, mDatas[0].B, mDatas[0].Diagonal);
     mSmoothers[0].Bind(d, l, b, pressure);
 
-    auto s = mDepth.GetDepthSize(0);
-    mTransfer.RestrictBind(0, s, mResiduals[0], d, mDatas[0].B, mDatas[0].Diagonal);
     mTransfer.ProlongateBind(0, s, pressure, d, mDatas[0].X, mDatas[0].Diagonal);
 }
 
@@ -142,18 +137,13 @@ void Multigrid::RecursiveBind(Pressure& pressure, std::size_t depth)
         mLiquidPhiScaleWorkBound.push_back(mPhiScaleWork.Bind(s1, {mLiquidPhis[depth - 1], mLiquidPhis[depth]}));
         mSolidPhiScaleWorkBound.push_back(mPhiScaleWork.Bind(s1, {mSolidPhis[depth - 1], mSolidPhis[depth]}));
 
-        mResidualWorkBound[depth] =
-                    mResidualWork.Bind(s0, {mDatas[depth-1].X,
-                                           mDatas[depth-1].Diagonal,
-                                           mDatas[depth-1].Lower,
-                                           mDatas[depth-1].B,
-                                           mResiduals[depth]});
-
-        mTransfer.RestrictBind(depth, s0,
-                               mResiduals[depth],
-                               mDatas[depth-1].Diagonal,
-                               mDatas[depth].B,
-                               mDatas[depth].Diagonal);
+        mTransfer.ResidualRestrictBind(depth, s0,
+                                       mDatas[depth-1].X,
+                                       mDatas[depth-1].Diagonal,
+                                       mDatas[depth-1].Lower,
+                                       mDatas[depth-1].B,
+                                       mDatas[depth].B,
+                                       mDatas[depth].Diagonal);
 
         mTransfer.ProlongateBind(depth, s0,
                                  mDatas[depth-1].X,
@@ -204,10 +194,8 @@ void Multigrid::Record(vk::CommandBuffer commandBuffer)
     {
         Smoother(commandBuffer, i, numIterations);
 
-        mResidualWorkBound[i].Record(commandBuffer);
-        mResiduals[i].Barrier(commandBuffer, vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead);
-
-        mTransfer.Restrict(commandBuffer, i);
+        // residual and restrict fused in one kernel
+        mTransfer.ResidualRestrict(commandBuffer, i);
 
         mDatas[i].X.Clear(commandBuffer);
     }
@@ -96,9 +96,6 @@ private:
     Depth mDepth;
     float mDelta;
 
-    Renderer::Work mResidualWork;
-    std::vector<Renderer::Work::Bound> mResidualWorkBound;
-
     Transfer mTransfer;
 
     Renderer::GenericBuffer* mPressure = nullptr;
@@ -106,9 +103,6 @@ private:
     // mDatas[0]  is level 1
     std::vector<LinearSolver::Data> mDatas;
 
-    // mResiduals[0] is level 0
-    std::vector<Renderer::Buffer<float>> mResiduals;
-
     Renderer::Work mPhiScaleWork;
     std::vector<Renderer::Work::Bound> mSolidPhiScaleWorkBound;
     std::vector<Renderer::Work::Bound> mLiquidPhiScaleWorkBound;
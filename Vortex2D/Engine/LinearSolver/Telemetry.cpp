@@ -0,0 +1,108 @@
+//
+//  Telemetry.cpp
+//  Vortex2D
+//
+
+#include "Telemetry.h"
+
+#include <algorithm>
+
+#include "vortex2d_generated_spirv.h"
+
+namespace Vortex2D { namespace Fluid {
+
+Telemetry::Telemetry(const Renderer::Device& device, unsigned capacity, unsigned ringSize)
+    : mCapacity(capacity)
+    , mCount(device)
+    , mResiduals(device, capacity)
+    , mAppendWork(device, glm::ivec2(1), SPIRV::Telemetry_comp)
+    , mResetCmd(device, false)
+    , mAppendCmd(device, false)
+    , mWriteIndex(0)
+    , mReadIndex(0)
+    , mPending(0)
+{
+    for (unsigned i = 0; i < ringSize; i++)
+    {
+        mLocalCounts.emplace_back(device, 1, VMA_MEMORY_USAGE_GPU_TO_CPU);
+        mLocalResiduals.emplace_back(device, capacity, VMA_MEMORY_USAGE_GPU_TO_CPU);
+        mReadCmds.emplace_back(device, true);
+    }
+
+    for (unsigned i = 0; i < ringSize; i++)
+    {
+        mReadCmds[i].Record([&](vk::CommandBuffer commandBuffer)
+        {
+            mLocalCounts[i].CopyFrom(commandBuffer, mCount);
+            mLocalResiduals[i].CopyFrom(commandBuffer, mResiduals);
+        });
+    }
+
+    mResetCmd.Record([&](vk::CommandBuffer commandBuffer)
+    {
+        mCount.Clear(commandBuffer);
+    });
+}
+
+void Telemetry::Bind(Renderer::GenericBuffer& error)
+{
+    mAppendBound = mAppendWork.Bind({error, mCount, mResiduals});
+    mAppendCmd.Record([&](vk::CommandBuffer commandBuffer)
+    {
+        commandBuffer.debugMarkerBeginEXT({"Telemetry", {{0.42f, 0.71f, 0.29f, 1.0f}}});
+        mAppendBound.PushConstant(commandBuffer, (int)mCapacity);
+        mAppendBound.Record(commandBuffer);
+        mCount.Barrier(commandBuffer, vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead);
+        mResiduals.Barrier(commandBuffer, vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead);
+        commandBuffer.debugMarkerEndEXT();
+    });
+}
+
+void Telemetry::Reset()
+{
+    mResetCmd.Submit();
+}
+
+void Telemetry::Append()
+{
+    mAppendCmd.Submit();
+}
+
+void Telemetry::Submit()
+{
+    // Wait for the previous copy using these buffers, only when its residuals are dropped
+    mReadCmds[mWriteIndex].Wait();
+    mReadCmds[mWriteIndex].Submit();
+    mWriteIndex = (mWriteIndex + 1) % mReadCmds.size();
+
+    if (mPending == mReadCmds.size())
+    {
+        mReadIndex = (mReadIndex + 1) % mReadCmds.size();
+    }
+    else
+    {
+        mPending++;
+    }
+}
+
+bool Telemetry::Read(std::vector<float>& residuals)
+{
+    if (mPending == 0 || !mReadCmds[mReadIndex].IsFinished())
+    {
+        return false;
+    }
+
+    int count;
+    Renderer::CopyTo(mLocalCounts[mReadIndex], count);
+
+    residuals.resize(mCapacity);
+    Renderer::CopyTo(mLocalResiduals[mReadIndex], residuals);
+    residuals.resize(std::min(static_cast<unsigned>(count), mCapacity));
+
+    mReadIndex = (mReadIndex + 1) % mReadCmds.size();
+    mPending--;
+
+    return true;
+}
+
+}}
@@ -0,0 +1,80 @@
+//
+//  Telemetry.h
+//  Vortex2D
+//
+
+#ifndef Vortex2D_Telemetry_h
+#define Vortex2D_Telemetry_h
+
+#include <Vortex2D/Renderer/Common.h>
+#include <Vortex2D/Renderer/Device.h>
+#include <Vortex2D/Renderer/Buffer.h>
+#include <Vortex2D/Renderer/Work.h>
+#include <Vortex2D/Renderer/CommandBuffer.h>
+
+#include <vector>
+
+namespace Vortex2D { namespace Fluid {
+
+/**
+ * @brief Records the residual of each iteration of a linear solver on the GPU.
+ * The residuals are copied to a small ring of host buffers at the end of the solve
+ * and can be read later without stalling the solver.
+ */
+class Telemetry
+{
+public:
+    /**
+     * @brief Initialize the telemetry with a capacity and ring size.
+     * @param device vulkan device
+     * @param capacity maximum number of residuals recorded per solve
+     * @param ringSize number of solves that can be pending a read
+     */
+    VORTEX2D_API Telemetry(const Renderer::Device& device, unsigned capacity = 64, unsigned ringSize = 3);
+
+    /**
+     * @brief Bind the buffer containing the error of the linear solver.
+     * @param error buffer of size 1 with the max residual
+     */
+    VORTEX2D_API void Bind(Renderer::GenericBuffer& error);
+
+    /**
+     * @brief Clear the recorded residuals, called at the start of a solve.
+     */
+    VORTEX2D_API void Reset();
+
+    /**
+     * @brief Append the current error to the recorded residuals, called after each iteration.
+     */
+    VORTEX2D_API void Append();
+
+    /**
+     * @brief Copy the recorded residuals to the next host buffer of the ring. Non-blocking,
+     * unless all the host buffers are pending a read: the oldest one is then overwritten once its copy has completed.
+     */
+    VORTEX2D_API void Submit();
+
+    /**
+     * @brief Read the residuals of the oldest solve, if its copy has completed. Non-blocking.
+     * @param residuals the residuals of each iteration, the first one is the initial residual.
+     * @return true if residuals were read.
+     */
+    VORTEX2D_API bool Read(std::vector<float>& residuals);
+
+private:
+    unsigned mCapacity;
+    Renderer::Buffer<int> mCount;
+    Renderer::Buffer<float> mResiduals;
+    Renderer::Work mAppendWork;
+    Renderer::Work::Bound mAppendBound;
+    Renderer::CommandBuffer mResetCmd, mAppendCmd;
+
+    std::vector<Renderer::Buffer<int>> mLocalCounts;
+    std::vector<Renderer::Buffer<float>> mLocalResiduals;
+    std::vector<Renderer::CommandBuffer> mReadCmds;
+    unsigned mWriteIndex, mReadIndex, mPending;
+};
+
+}}
+
+#endif
@@ -13,6 +13,7 @@ Transfer::Transfer(const Renderer::Device& device)
     : mDevice(device)
     , mProlongateWork(device, Renderer::ComputeSize::Default2D(), SPIRV::Prolongate_comp)
     , mRestrictWork(device, Renderer::ComputeSize::Default2D(), SPIRV::Restrict_comp)
+    , mResidualRestrictWork(device, Renderer::ComputeSize::Default2D(), SPIRV::ResidualRestrict_comp)
 {
 
 }
@@ -51,6 +52,27 @@ void Transfer::RestrictBind(std::size_t level, const glm::ivec2& fineSize,
     mRestrictBuffer[level] = &coarse;
 }
 
+void Transfer::ResidualRestrictBind(std::size_t level,
+                                    const glm::ivec2& fineSize,
+                                    Renderer::GenericBuffer& x,
+                                    Renderer::GenericBuffer& d,
+                                    Renderer::GenericBuffer& l,
+                                    Renderer::GenericBuffer& b,
+                                    Renderer::GenericBuffer& coarse,
+                                    Renderer::GenericBuffer& coarseDiagonal)
+{
+    if (mResidualRestrictBound.size() < level + 1)
+    {
+        mResidualRestrictBound.resize(level + 1);
+        mResidualRestrictBuffer.resize(level + 1);
+    }
+
+    // Dispatched on the fine size, with tiles overlapping by one cell for the stencil
+    mResidualRestrictBound[level] = mResidualRestrictWork.Bind(Renderer::MakeStencilComputeSize(fineSize, 1),
+                                                               {x, d, l, b, coarseDiagonal, coarse});
+    mResidualRestrictBuffer[level] = &coarse;
+}
+
 void Transfer::Prolongate(vk::CommandBuffer commandBuffer, std::size_t level)
 {
     assert(level < mProlongateBound.size());
@@ -67,4 +89,12 @@ void Transfer::Restrict(vk::CommandBuffer commandBuffer, std::size_t level)
     mRestrictBuffer[level]->Barrier(commandBuffer, vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead);
 }
 
+void Transfer::ResidualRestrict(vk::CommandBuffer commandBuffer, std::size_t level)
+{
+    assert(level < mResidualRestrictBound.size());
+
+    mResidualRestrictBound[level].Record(commandBuffer);
+    mResidualRestrictBuffer[level]->Barrier(commandBuffer, vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead);
+}
+
 }}
@@ -43,6 +43,8 @@ public:
     /**
      * @brief Restricing the level set on a coarser level set. Averages 4 cells into one.
      * Multiple level sets can be bound and indexed.
+     * Not used by @ref Multigrid, which restricts the residual with @ref ResidualRestrictBind,
+     * this is the reference the fused kernel is tested against.
      * @param level the index of the bound level set to prolongate
      * @param fineSize size of the finer level set
      * @param fine the finer level set
@@ -57,6 +59,28 @@ public:
                                    Renderer::GenericBuffer& coarse,
                                    Renderer::GenericBuffer& coarseDiagonal);
 
+    /**
+     * @brief Computes the residual of the linear equations and restricts it on a coarser level set,
+     * in a single dispatch. Same as computing the residual and calling @ref Restrict on it.
+     * Multiple level sets can be bound and indexed.
+     * @param level the index of the bound level set to restrict
+     * @param fineSize size of the finer level set
+     * @param x the solution at size @p fineSize
+     * @param d the diagonal of the linear equation matrix at size @p fineSize
+     * @param l the lower matrix of the linear equation at size @p fineSize
+     * @param b the right hand side of the linear equation at size @p fineSize
+     * @param coarse the coarse level set, set to the restricted residual
+     * @param coarseDiagonal the diagonal of the linear equation matrix at size half of @p fineSize
+     */
+    VORTEX2D_API void ResidualRestrictBind(std::size_t level,
+                                           const glm::ivec2& fineSize,
+                                           Renderer::GenericBuffer& x,
+                                           Renderer::GenericBuffer& d,
+                                           Renderer::GenericBuffer& l,
+                                           Renderer::GenericBuffer& b,
+                                           Renderer::GenericBuffer& coarse,
+                                           Renderer::GenericBuffer& coarseDiagonal);
+
     /**
      * @brief Prolongate the level set, using the bound level sets at the specified index.
      * @param commandBuffer command buffer to record into.
@@ -71,6 +95,13 @@ public:
      */
     VORTEX2D_API void Restrict(vk::CommandBuffer commandBuffer, std::size_t level);
 
+    /**
+     * @brief Restrict the residual, using the bound level sets at the specified index.
+     * @param commandBuffer command buffer to record into.
+     * @param level index of bound level sets.
+     */
+    VORTEX2D_API void ResidualRestrict(vk::CommandBuffer commandBuffer, std::size_t level);
+
 private:
     const Renderer::Device& mDevice;
     Renderer::Work mProlongateWork;
@@ -80,6 +111,10 @@ private:
     Renderer::Work mRestrictWork;
     std::vector<Renderer::Work::Bound> mRestrictBound;
     std::vector<Renderer::GenericBuffer*> mRestrictBuffer;
+
+    Renderer::Work mResidualRestrictWork;
+    std::vector<Renderer::Work::Bound> mResidualRestrictBound;
+    std::vector<Renderer::GenericBuffer*> mResidualRestrictBuffer;
 };
 
 }}
@@ -6,171 +6,829 @@
 #include "Particles.h"
 
 #include <Vortex2D/Engine/LevelSet.h>
+#include <Vortex2D/SPIRV/Reflection.h>
 
+#include <algorithm>
 #include <random>
 #include "vortex2d_generated_spirv.h"
 
 namespace Vortex2D { namespace Fluid {
 
+namespace
+{
+// Tile of the staged particle to grid kernels, including a border of one cell,
+// and maximum number of particles per cell, see ParticleToGrid.comp
+const int ParticleToGridTile = 10;
+const int ParticleToGridMaxParticles = 8;
+
+uint32_t GetParticleToGridSharedSize(bool affine)
+{
+    // A count per cell, and per particle the position and velocity, then the affine velocity
+    uint32_t particleSize = (affine ? 2 : 1) * sizeof(glm::vec4);
+    return ParticleToGridTile * ParticleToGridTile * (sizeof(int) + ParticleToGridMaxParticles * particleSize);
+}
+}
+
+Particles::Particles(const Renderer::Device& device,
+                     int capacity,
+                     bool attributes,
+                     bool compact,
+                     bool affine,
+                     VmaMemoryUsage memoryUsage)
+    : Capacity(capacity)
+    , HasAttributes(attributes)
+    , Compact(compact)
+    , HasAffine(affine)
+    , MemoryUsage(memoryUsage)
+    , Position(device, compact ? (capacity + 1) / 2 : capacity, memoryUsage)
+    , Velocity(device, compact ? (capacity + 1) / 2 : capacity, memoryUsage)
+    , Cell(device, compact ? capacity : 1, memoryUsage)
+    , Attribute(device, attributes ? capacity : 1, memoryUsage)
+    , Affine(device, affine ? capacity : 1, memoryUsage)
+{
+}
+
+void Particles::CopyFrom(vk::CommandBuffer commandBuffer, Particles& particles)
+{
+    auto copy = [&](Renderer::GenericBuffer& dst, Renderer::GenericBuffer& src)
+    {
+        dst.CopyFrom(commandBuffer, src, std::min(dst.Size(), src.Size()));
+    };
+
+    copy(Position, particles.Position);
+    copy(Velocity, particles.Velocity);
+    if (Compact)
+    {
+        copy(Cell, particles.Cell);
+    }
+    if (HasAttributes)
+    {
+        copy(Attribute, particles.Attribute);
+    }
+    if (HasAffine)
+    {
+        copy(Affine, particles.Affine);
+    }
+}
+
+void Particles::Barrier(vk::CommandBuffer commandBuffer, vk::AccessFlags oldAccess, vk::AccessFlags newAccess)
+{
+    Position.Barrier(commandBuffer, oldAccess, newAccess);
+    Velocity.Barrier(commandBuffer, oldAccess, newAccess);
+    if (Compact)
+    {
+        Cell.Barrier(commandBuffer, oldAccess, newAccess);
+    }
+    if (HasAttributes)
+    {
+        Attribute.Barrier(commandBuffer, oldAccess, newAccess);
+    }
+    if (HasAffine)
+    {
+        Affine.Barrier(commandBuffer, oldAccess, newAccess);
+    }
+}
+
 ParticleCount::ParticleCount(const Renderer::Device& device,
                              const glm::ivec2& size,
-                             Renderer::GenericBuffer& particles,
+                             Particles& particles,
                              const Renderer::DispatchParams& params,
                              float alpha)
     : Renderer::RenderTexture(device, size.x, size.y, vk::Format::eR32Sint)
     , mDevice(device)
-    , mParticles(particles)
-    , mNewParticles(device, 8*size.x*size.y)
+    , mSize(size)
     , mDelta(device, size.x*size.y)
     , mCount(device, size.x*size.y)
+    , mPending(device, size.x*size.y)
     , mIndex(device, size.x*size.y)
-    , mSeeds(device, 4, VMA_MEMORY_USAGE_CPU_TO_GPU)
+    , mBackIndex(device, size.x*size.y)
+    , mCountIndex(device, size.x*size.y)
+    , mRandomState(device, size.x*size.y)
+    , mEmitters(device, MaxEmitters)
+    , mLocalEmitters(device, MaxEmitters, VMA_MEMORY_USAGE_CPU_ONLY)
+    , mEmitterCount(device, 1)
+    , mLocalEmitterCount(device, 1, VMA_MEMORY_USAGE_CPU_ONLY)
+    , mEmitterUpload(device, true)
     , mDispatchParams(device)
+    , mBackDispatchParams(device)
+    , mRequestedParams(device)
+    , mCountParams(device)
     , mLocalDispatchParams(device, 1, VMA_MEMORY_USAGE_CPU_ONLY)
-    , mNewDispatchParams(device)
+    , mCapacityLimit(device, 1)
+    , mLocalCapacityLimit(device, 1, VMA_MEMORY_USAGE_CPU_ONLY)
+    , mCapacityUpload(device, true)
     , mParticleCountWork(device, Renderer::ComputeSize::Default1D(), SPIRV::ParticleCount_comp)
-    , mParticleCountBound(mParticleCountWork.Bind(size, {particles, mDispatchParams, mDelta}))
+    , mParticleEmitWork(device, size, SPIRV::ParticleEmit_comp)
+    , mParticleEmitBound(mParticleEmitWork.Bind(size, {mDelta, mEmitters, mEmitterCount, mRandomState}))
     , mParticleClampWork(device, size, SPIRV::ParticleClamp_comp)
-    , mParticleClampBound(mParticleClampWork.Bind(size, {mDelta }))
+    , mParticleClampBound(mParticleClampWork.Bind(size, {mDelta, mCount, mPending}))
     , mPrefixScan(device, size)
-    , mPrefixScanBound(mPrefixScan.Bind(mDelta, mIndex, mNewDispatchParams))
+    , mCountPrefixScan(device, size)
+    , mCountPrefixScanBound(mCountPrefixScan.Bind(mCount, mCountIndex, mCountParams))
+    , mParticleCapacityWork(device, size, SPIRV::ParticleCapacity_comp,
+                            Renderer::SpecConst(Renderer::SpecConstValue(3, Renderer::ComputeSize::GetLocalSize1D())))
     , mParticleBucketWork(device, Renderer::ComputeSize::Default1D(), SPIRV::ParticleBucket_comp)
-    , mParticleBucketBound(mParticleBucketWork.Bind(size, {particles,
-                                                           mNewParticles,
-                                                           mIndex,
-                                                           mDelta,
-                                                           mDispatchParams}))
     , mParticleSpawnWork(device, size, SPIRV::ParticleSpawn_comp)
-    , mParticleSpawnBound(mParticleSpawnWork.Bind({mNewParticles, mIndex, mDelta, mSeeds}))
     , mParticlePhiWork(device, size, SPIRV::ParticlePhi_comp)
-    , mParticleToGridWork(device, size, SPIRV::ParticleToGrid_comp)
-    , mParticleFromGridWork(device, Renderer::ComputeSize::Default1D(), SPIRV::ParticleFromGrid_comp)
-    , mScanWork(device, false)
-    , mDispatchCountWork(device)
-    , mParticlePhi(device, false)
-    , mParticleToGrid(device, false)
-    , mParticleFromGrid(device, false)
+    , mCountWriteIndex(0)
+    , mScanNumber(0)
+    , mLatestCount(-1)
+    , mLatestRequested(-1)
+    , mLatestScan(-1)
+    , mHighWaterMark(0)
+    , mTargetCapacity(particles.Capacity)
+    , mTargetScan(0)
+    , mLevelSet(nullptr)
+    , mVelocity(nullptr)
+    , mValid(nullptr)
+    , mParity(0)
     , mAlpha(alpha)
+    , mResizeCmd(device, true)
 {
+    if (particles.Compact && params.count != 0)
+    {
+        throw std::runtime_error("Compact particles can only be added by the scan");
+    }
+
+    mOwnedParticles.push_back(std::make_unique<Particles>(device,
+                                                          particles.Capacity,
+                                                          particles.HasAttributes,
+                                                          particles.Compact,
+                                                          particles.HasAffine,
+                                                          particles.MemoryUsage));
+    mParticleBuffers = {&particles, mOwnedParticles.back().get()};
+
     Renderer::CopyFrom(mLocalDispatchParams, params);
     Renderer::ExecuteCommand(device, [&](vk::CommandBuffer commandBuffer)
     {
         mDispatchParams.CopyFrom(commandBuffer, mLocalDispatchParams);
     });
 
-    // TODO clamp should be configurable
-    mScanWork.Record([&](vk::CommandBuffer commandBuffer)
-    {
-		commandBuffer.debugMarkerBeginEXT({ "Particle count",{ { 0.14f, 0.39f, 0.12f, 1.0f } } });
-        mDelta.CopyFrom(commandBuffer, *this);
-        Clear(commandBuffer, std::array<int, 4>{0, 0, 0, 0});
-        mParticleCountBound.RecordIndirect(commandBuffer, mDispatchParams);
-        mDelta.Barrier(commandBuffer, vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead);
-        mParticleClampBound.Record(commandBuffer);
-        mDelta.Barrier(commandBuffer, vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead);
-        mCount.CopyFrom(commandBuffer, mDelta);
-		commandBuffer.debugMarkerEndEXT();
-
-        commandBuffer.debugMarkerBeginEXT({"Particle scan", {{ 0.59f, 0.20f, 0.35f, 1.0f}}});
-        mPrefixScanBound.Record(commandBuffer);
-        mParticleBucketBound.RecordIndirect(commandBuffer, mDispatchParams);
-        mNewParticles.Barrier(commandBuffer, vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead);
-        mParticleSpawnBound.Record(commandBuffer);
-        mNewParticles.Barrier(commandBuffer, vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead);
-        particles.CopyFrom(commandBuffer, mNewParticles);
-        mDispatchParams.CopyFrom(commandBuffer, mNewDispatchParams);
-        commandBuffer.debugMarkerEndEXT();
+    SetSeed(std::random_device()());
 
+    Renderer::CopyFrom(mLocalCapacityLimit, particles.Capacity);
+    mCapacityUpload.Record([&](vk::CommandBuffer commandBuffer)
+    {
+        mCapacityLimit.CopyFrom(commandBuffer, mLocalCapacityLimit);
     });
+    mCapacityUpload.Submit();
+
+    BindScan();
 
-    mDispatchCountWork.Record([&](vk::CommandBuffer commandBuffer)
+    for (int parity = 0; parity < 2; parity++)
     {
-        mLocalDispatchParams.CopyFrom(commandBuffer, mDispatchParams);
-    });
+        mDispatchCountWork.emplace_back(device);
+        mDispatchCountWork.back().Record([&, parity](vk::CommandBuffer commandBuffer)
+        {
+            mLocalDispatchParams.CopyFrom(commandBuffer, GetDispatchParams(parity));
+        });
+    }
+
+    const std::size_t ringSize = 3;
+    for (std::size_t i = 0; i < ringSize; i++)
+    {
+        mCountReadbacks.emplace_back(device, 1, VMA_MEMORY_USAGE_GPU_TO_CPU);
+        mRequestedReadbacks.emplace_back(device, 1, VMA_MEMORY_USAGE_GPU_TO_CPU);
+        mCountScans.push_back(-1);
+        mCountPending.push_back(false);
+    }
+
+    for (std::size_t i = 0; i < ringSize; i++)
+    {
+        for (int parity = 0; parity < 2; parity++)
+        {
+            mCountReadCmds.emplace_back(device, true);
+            mCountReadCmds.back().Record([&, i, parity](vk::CommandBuffer commandBuffer)
+            {
+                mCountReadbacks[i].CopyFrom(commandBuffer, GetDispatchParams(parity));
+                mRequestedReadbacks[i].CopyFrom(commandBuffer, mRequestedParams);
+            });
+        }
+    }
+}
+
+void ParticleCount::BindScan()
+{
+    mParticleCountBound.clear();
+    mPrefixScanBound.clear();
+    mParticleCapacityBound.clear();
+    mParticleBucketBound.clear();
+    mParticleSpawnBound.clear();
+    mScanWork.clear();
+
+    for (int parity = 0; parity < 2; parity++)
+    {
+        Particles& current = GetParticles(parity);
+        Particles& next = GetParticles(1 - parity);
+        auto& dispatchParams = GetDispatchParams(parity);
+        auto& nextDispatchParams = GetDispatchParams(1 - parity);
+        auto& nextIndex = GetIndex(1 - parity);
+
+        mParticleCountBound.push_back(mParticleCountWork.Bind(mSize, {current.Position, dispatchParams, mCount, current.Cell}));
+        mPrefixScanBound.push_back(mPrefixScan.Bind(mDelta, nextIndex, mRequestedParams));
+        mParticleCapacityBound.push_back(mParticleCapacityWork.Bind({mDelta,
+                                                                     mCount,
+                                                                     nextIndex,
+                                                                     mCountIndex,
+                                                                     mPending,
+                                                                     mRequestedParams,
+                                                                     mCountParams,
+                                                                     nextDispatchParams,
+                                                                     mCapacityLimit}));
+        mParticleBucketBound.push_back(mParticleBucketWork.Bind(mSize, {current.Position,
+                                                                         current.Velocity,
+                                                                         current.Attribute,
+                                                                         next.Position,
+                                                                         next.Velocity,
+                                                                         next.Attribute,
+                                                                         nextIndex,
+                                                                         mDelta,
+                                                                         dispatchParams,
+                                                                         current.Affine,
+                                                                         next.Affine,
+                                                                         current.Cell,
+                                                                         next.Cell}));
+        mParticleSpawnBound.push_back(mParticleSpawnWork.Bind({next.Position,
+                                                               next.Velocity,
+                                                               next.Attribute,
+                                                               nextIndex,
+                                                               mDelta,
+                                                               mRandomState,
+                                                               next.Affine,
+                                                               next.Cell}));
+
+        // The particles of each cell are clamped to 8. The particles kept with only the removals applied (count)
+        // and the particles requested with all the additions (delta) are both scanned: if the requested particles
+        // don't fit in the capacity, the positive additions stay pending, see ParticleCapacity.comp
+        mScanWork.emplace_back(mDevice, false);
+        mScanWork.back().Record([&, parity](vk::CommandBuffer commandBuffer)
+        {
+            commandBuffer.debugMarkerBeginEXT({ "Particle count",{ { 0.14f, 0.39f, 0.12f, 1.0f } } });
+            mDelta.CopyFrom(commandBuffer, *this);
+            Clear(commandBuffer, std::array<int, 4>{0, 0, 0, 0});
+            mParticleEmitBound.Record(commandBuffer);
+            mDelta.Barrier(commandBuffer, vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead);
+            mRandomState.Barrier(commandBuffer, vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite);
+            mEmitterCount.Clear(commandBuffer);
+            mCount.Clear(commandBuffer);
+            mParticleCountBound[parity].PushConstant(commandBuffer, (int)current.Compact);
+            mParticleCountBound[parity].RecordIndirect(commandBuffer, dispatchParams);
+            mCount.Barrier(commandBuffer, vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead);
+            mParticleClampBound.Record(commandBuffer);
+            mDelta.Barrier(commandBuffer, vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead);
+            mCount.Barrier(commandBuffer, vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead);
+            mPending.Barrier(commandBuffer, vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead);
+            commandBuffer.debugMarkerEndEXT();
+
+            commandBuffer.debugMarkerBeginEXT({"Particle scan", {{ 0.59f, 0.20f, 0.35f, 1.0f}}});
+            mPrefixScanBound[parity].Record(commandBuffer);
+            mCountPrefixScanBound.Record(commandBuffer);
+            mParticleCapacityBound[parity].Record(commandBuffer);
+            mDelta.Barrier(commandBuffer, vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead);
+            mCount.Barrier(commandBuffer, vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead);
+            mPending.Barrier(commandBuffer, vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead);
+            nextIndex.Barrier(commandBuffer, vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead);
+            nextDispatchParams.Barrier(commandBuffer, vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eIndirectCommandRead);
+            mParticleBucketBound[parity].PushConstant(commandBuffer, (int)current.HasAttributes, (int)current.Compact, (int)current.HasAffine);
+            mParticleBucketBound[parity].RecordIndirect(commandBuffer, dispatchParams);
+            next.Barrier(commandBuffer, vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead);
+            mParticleSpawnBound[parity].PushConstant(commandBuffer, (int)current.HasAttributes, (int)current.Compact, (int)current.HasAffine);
+            mParticleSpawnBound[parity].Record(commandBuffer);
+            next.Barrier(commandBuffer, vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead);
+            mRandomState.Barrier(commandBuffer, vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite);
+            commandBuffer.debugMarkerEndEXT();
+        });
+    }
 }
 
 void ParticleCount::Scan()
 {
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_int_distribution<> dis;
+    mScanWork[mParity].Submit();
+    mParity = 1 - mParity;
+
+    // If the copy of the slot hasn't completed, the GPU is several scans behind: this count is skipped
+    // rather than resetting a fence in use or writing the host buffer while it could be read.
+    // If the slot has completed but is still pending a read, it is overwritten.
+    if (!mCountReadCmds[2 * mCountWriteIndex].IsFinished() ||
+        !mCountReadCmds[2 * mCountWriteIndex + 1].IsFinished())
+    {
+        mScanNumber++;
+        return;
+    }
+
+    mCountReadCmds[2 * mCountWriteIndex + mParity].Submit();
+    mCountScans[mCountWriteIndex] = mScanNumber++;
+    mCountPending[mCountWriteIndex] = true;
+    mCountWriteIndex = (mCountWriteIndex + 1) % mCountReadbacks.size();
+}
+
+void ParticleCount::SetEmitters(const std::vector<ParticleEmitter>& emitters)
+{
+    if (emitters.size() > MaxEmitters) throw std::runtime_error("Too many emitters");
+
+    // Wait for the previous upload to finish reading the local buffers
+    mEmitterUpload.Wait();
 
-    std::vector<glm::ivec2> seeds = {{dis(gen), dis(gen)},
-                                     {dis(gen), dis(gen)},
-                                     {dis(gen), dis(gen)},
-                                     {dis(gen), dis(gen)}};
+    std::vector<ParticleEmitter> localEmitters(emitters);
+    localEmitters.resize(MaxEmitters);
+    Renderer::CopyFrom(mLocalEmitters, localEmitters);
+    Renderer::CopyFrom(mLocalEmitterCount, static_cast<int>(emitters.size()));
 
-    Renderer::CopyFrom(mSeeds, seeds);
-    mScanWork.Submit();
+    vk::DeviceSize size = std::max<std::size_t>(1, emitters.size()) * sizeof(ParticleEmitter);
+    mEmitterUpload.Record([&, size](vk::CommandBuffer commandBuffer)
+    {
+        mEmitters.CopyFrom(commandBuffer, mLocalEmitters, size);
+        mEmitterCount.CopyFrom(commandBuffer, mLocalEmitterCount);
+    });
+    mEmitterUpload.Submit();
+}
+
+void ParticleCount::SetSeed(uint32_t seed)
+{
+    // Same permutation as the generator of the particle kernels, used to give each cell a different state
+    auto hash = [](uint32_t x)
+    {
+        uint32_t state = x * 747796405u + 2891336453u;
+        uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+        return (word >> 22u) ^ word;
+    };
+
+    std::vector<uint32_t> states(mRandomState.Size() / sizeof(uint32_t));
+    for (std::size_t i = 0; i < states.size(); i++)
+    {
+        states[i] = hash(seed ^ hash(static_cast<uint32_t>(i)));
+    }
+
+    Renderer::Buffer<uint32_t> localStates(mDevice, states.size(), VMA_MEMORY_USAGE_CPU_ONLY);
+    Renderer::CopyFrom(localStates, states);
+    Renderer::ExecuteCommand(mDevice, [&](vk::CommandBuffer commandBuffer)
+    {
+        mRandomState.CopyFrom(commandBuffer, localStates);
+    });
 }
 
 int ParticleCount::GetTotalCount()
 {
-    mDispatchCountWork.Submit();
-    mDispatchCountWork.Wait();
+    mDispatchCountWork[mParity].Submit();
+    mDispatchCountWork[mParity].Wait();
 
     Renderer::DispatchParams params(0);
     Renderer::CopyTo(mLocalDispatchParams, params);
+    mHighWaterMark = std::max(mHighWaterMark, static_cast<int>(params.count));
     return params.count;
 }
 
+int ParticleCount::GetLatestTotalCount()
+{
+    // Look for the most recent completed copy, starting from the last one submitted
+    std::size_t ringSize = mCountReadbacks.size();
+    for (std::size_t i = 1; i <= ringSize; i++)
+    {
+        std::size_t slot = (mCountWriteIndex + ringSize - i) % ringSize;
+        if (mCountPending[slot] &&
+            mCountReadCmds[2 * slot].IsFinished() &&
+            mCountReadCmds[2 * slot + 1].IsFinished())
+        {
+            Renderer::DispatchParams params(0);
+            Renderer::CopyTo(mCountReadbacks[slot], params);
+            mLatestCount = params.count;
+
+            Renderer::CopyTo(mRequestedReadbacks[slot], params);
+            mLatestRequested = params.count;
+            mLatestScan = mCountScans[slot];
+            mHighWaterMark = std::max(mHighWaterMark, mLatestRequested);
+
+            // Older copies are superseded by this one
+            for (std::size_t j = i; j <= ringSize; j++)
+            {
+                mCountPending[(mCountWriteIndex + ringSize - j) % ringSize] = false;
+            }
+
+            break;
+        }
+    }
+
+    return mLatestCount;
+}
+
+int ParticleCount::GetCapacity()
+{
+    return GetParticles().Capacity;
+}
+
+int ParticleCount::GetHighWaterMark() const
+{
+    return mHighWaterMark;
+}
+
+void ParticleCount::SetCapacity(int capacity)
+{
+    capacity = std::max(1, std::min(capacity, 8 * mSize.x * mSize.y));
+    if (capacity > GetCapacity())
+    {
+        Reallocate(capacity);
+    }
+    else
+    {
+        // The buffers are reallocated by UpdateCapacity, once the scans have brought the particles under the capacity
+        SetCapacityLimit(capacity);
+    }
+}
+
+void ParticleCount::SetCapacityPolicy(const ParticleCapacityPolicy& policy)
+{
+    mCapacityPolicy = policy;
+}
+
+bool ParticleCount::UpdateCapacity()
+{
+    // Only one reallocation at a time, see Reallocate
+    if (!mResizeCmd.IsFinished())
+    {
+        return false;
+    }
+
+    int count = GetLatestTotalCount();
+    if (count < 0)
+    {
+        return false;
+    }
+
+    // The scans since the limit was set can't add particles beyond it, so once a count fits
+    // the particles can't be truncated
+    if (mTargetCapacity < GetCapacity() && mLatestScan >= mTargetScan && count <= mTargetCapacity)
+    {
+        Reallocate(mTargetCapacity);
+        return true;
+    }
+
+    int newCapacity = mTargetCapacity;
+    if (mLatestRequested > mCapacityPolicy.GrowThreshold * mTargetCapacity)
+    {
+        newCapacity = static_cast<int>(mLatestRequested * mCapacityPolicy.Headroom);
+    }
+    else if (mHighWaterMark < mCapacityPolicy.ShrinkThreshold * mTargetCapacity)
+    {
+        newCapacity = static_cast<int>(mHighWaterMark * mCapacityPolicy.Headroom);
+    }
+
+    newCapacity = std::max(newCapacity, mCapacityPolicy.MinCapacity);
+    newCapacity = std::min(newCapacity, 8 * mSize.x * mSize.y);
+    if (newCapacity == mTargetCapacity)
+    {
+        return false;
+    }
+
+    int capacity = GetCapacity();
+    SetCapacity(newCapacity);
+    return capacity != GetCapacity();
+}
+
+void ParticleCount::SetCapacityLimit(int capacity)
+{
+    if (capacity == mTargetCapacity)
+    {
+        return;
+    }
+
+    // Wait for the previous upload to finish reading the local buffer
+    mCapacityUpload.Wait();
+    Renderer::CopyFrom(mLocalCapacityLimit, capacity);
+    mCapacityUpload.Submit();
+
+    mTargetCapacity = capacity;
+    mTargetScan = mScanNumber;
+    mHighWaterMark = std::max(0, mLatestRequested);
+}
+
+template<typename T>
+void ParticleCount::Retire(std::vector<T>& objects)
+{
+    mRetired.push_back(std::make_shared<std::vector<T>>(std::move(objects)));
+    objects.clear();
+}
+
+void ParticleCount::Reallocate(int capacity)
+{
+    // The objects bound to the previous buffers are not used after the previous reallocation was submitted,
+    // they can be released once it has completed
+    mResizeCmd.Wait();
+    mRetired.clear();
+
+    Particles& current = GetParticles();
+
+    std::vector<std::unique_ptr<Particles>> particles;
+    for (int i = 0; i < 2; i++)
+    {
+        particles.push_back(std::make_unique<Particles>(mDevice,
+                                                        capacity,
+                                                        current.HasAttributes,
+                                                        current.Compact,
+                                                        current.HasAffine,
+                                                        current.MemoryUsage));
+    }
+
+    // The copy is done on the device, the capacity is never smaller than the number of particles
+    mResizeCmd.Record([&](vk::CommandBuffer commandBuffer)
+    {
+        particles[0]->CopyFrom(commandBuffer, current);
+        if (mParity == 1)
+        {
+            mIndex.CopyFrom(commandBuffer, mBackIndex);
+            mDispatchParams.CopyFrom(commandBuffer, mBackDispatchParams);
+        }
+    });
+    mResizeCmd.Submit();
+
+    Retire(mOwnedParticles);
+    Retire(mParticleCountBound);
+    Retire(mPrefixScanBound);
+    Retire(mParticleCapacityBound);
+    Retire(mParticleBucketBound);
+    Retire(mParticleSpawnBound);
+    Retire(mScanWork);
+    Retire(mParticlePhiBound);
+    Retire(mParticlePhi);
+    Retire(mParticleToGridBound);
+    Retire(mParticleToGrid);
+    Retire(mParticleFromGridBound);
+    Retire(mParticleFromGrid);
+
+    mOwnedParticles = std::move(particles);
+    mParticleBuffers = {mOwnedParticles[0].get(), mOwnedParticles[1].get()};
+    mParity = 0;
+
+    SetCapacityLimit(capacity);
+
+    BindScan();
+    if (mLevelSet)
+    {
+        BindLevelSet();
+    }
+    if (mVelocity && mValid)
+    {
+        BindVelocities();
+    }
+}
+
 Renderer::IndirectBuffer<Renderer::DispatchParams>& ParticleCount::GetDispatchParams()
 {
-    return mDispatchParams;
+    return GetDispatchParams(mParity);
+}
+
+Renderer::IndirectBuffer<Renderer::DispatchParams>& ParticleCount::GetDispatchParams(int parity)
+{
+    return parity == 0 ? mDispatchParams : mBackDispatchParams;
+}
+
+Renderer::Buffer<int>& ParticleCount::GetIndex(int parity)
+{
+    return parity == 0 ? mIndex : mBackIndex;
+}
+
+Particles& ParticleCount::GetParticles()
+{
+    return GetParticles(mParity);
+}
+
+Particles& ParticleCount::GetParticles(int parity)
+{
+    return *mParticleBuffers[parity];
+}
+
+int ParticleCount::GetParity() const
+{
+    return mParity;
 }
 
 void ParticleCount::LevelSetBind(LevelSet& levelSet)
 {
     // TODO should shrink wrap wholes and redistance
-    mParticlePhiBound = mParticlePhiWork.Bind({mCount, mParticles, mIndex, levelSet});
-    mParticlePhi.Record([&](vk::CommandBuffer commandBuffer)
-    {
-        commandBuffer.debugMarkerBeginEXT({"Particle phi", {{ 0.86f, 0.72f, 0.29f, 1.0f}}});
-        levelSet.Clear(commandBuffer, std::array<float, 4>{3.0f, 0.0f, 0.0f, 0.0f});
-        mParticlePhiBound.Record(commandBuffer);
-        levelSet.Barrier(commandBuffer,
-                         vk::ImageLayout::eGeneral, vk::AccessFlagBits::eShaderWrite,
-                         vk::ImageLayout::eGeneral, vk::AccessFlagBits::eShaderRead);
-        commandBuffer.debugMarkerEndEXT();
-    });
+    mLevelSet = &levelSet;
+    BindLevelSet();
+}
+
+void ParticleCount::BindLevelSet()
+{
+    LevelSet& levelSet = *mLevelSet;
+    mParticlePhiBound.clear();
+    mParticlePhi.clear();
+    for (int parity = 0; parity < 2; parity++)
+    {
+        mParticlePhiBound.push_back(mParticlePhiWork.Bind({mCount, GetParticles(parity).Position, GetIndex(parity), levelSet}));
+        mParticlePhi.emplace_back(mDevice, false);
+        mParticlePhi.back().Record([&, parity](vk::CommandBuffer commandBuffer)
+        {
+            commandBuffer.debugMarkerBeginEXT({"Particle phi", {{ 0.86f, 0.72f, 0.29f, 1.0f}}});
+            levelSet.Clear(commandBuffer, std::array<float, 4>{3.0f, 0.0f, 0.0f, 0.0f});
+            mParticlePhiBound[parity].PushConstant(commandBuffer, (int)GetParticles(parity).Compact);
+            mParticlePhiBound[parity].Record(commandBuffer);
+            levelSet.Barrier(commandBuffer,
+                             vk::ImageLayout::eGeneral, vk::AccessFlagBits::eShaderWrite,
+                             vk::ImageLayout::eGeneral, vk::AccessFlagBits::eShaderRead);
+            commandBuffer.debugMarkerEndEXT();
+        });
+    }
 }
 
 void ParticleCount::Phi()
 {
-    mParticlePhi.Submit();
+    mParticlePhi[mParity].Submit();
 }
 
 void ParticleCount::VelocitiesBind(Velocity& velocity, Renderer::GenericBuffer& valid)
 {
-    mParticleToGridBound = mParticleToGridWork.Bind({mCount, mParticles, mIndex, velocity, valid});
-    mParticleToGrid.Record([&](vk::CommandBuffer commandBuffer)
+    mVelocity = &velocity;
+    mValid = &valid;
+
+    // The kernels depend on the precision of the velocity, so they are only created once it is known
+    glm::ivec2 size(GetWidth(), GetHeight());
+    bool affine = GetParticles(0).HasAffine;
+    if (GetParticleToGridSharedSize(affine) <= mDevice.GetPhysicalDevice().getProperties().limits.maxComputeSharedMemorySize)
     {
-        commandBuffer.debugMarkerBeginEXT({"Particle to grid", {{ 0.71f, 0.15f, 0.48f, 1.0f}}});
-        valid.Clear(commandBuffer);
-        mParticleToGridBound.Record(commandBuffer);
-        valid.Barrier(commandBuffer, vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead);
-        commandBuffer.debugMarkerEndEXT();
-    });
+        mParticleToGridWork = std::make_unique<Renderer::Work>(mDevice,
+                                                               Renderer::MakeStencilComputeSize(size, 1, glm::ivec2(ParticleToGridTile)),
+                                                               affine ? velocity.SelectSpirv(SPIRV::ParticleToGridAffine_comp, SPIRV::ParticleToGridAffineHalf_comp)
+                                                                      : velocity.SelectSpirv(SPIRV::ParticleToGrid_comp, SPIRV::ParticleToGridHalf_comp));
+    }
+    else
+    {
+        // Not enough shared memory for the tiles, the particles are read from the buffers
+        mParticleToGridWork = std::make_unique<Renderer::Work>(mDevice,
+                                                               size,
+                                                               velocity.SelectSpirv(SPIRV::ParticleToGridUnstaged_comp, SPIRV::ParticleToGridUnstagedHalf_comp));
+    }
+    mParticleFromGridWork = std::make_unique<Renderer::Work>(mDevice,
+                                                             Renderer::ComputeSize::Default1D(),
+                                                             velocity.SelectSpirv(SPIRV::ParticleFromGrid_comp, SPIRV::ParticleFromGridHalf_comp));
+
+    BindVelocities();
+}
+
+void ParticleCount::BindVelocities()
+{
+    Velocity& velocity = *mVelocity;
+    Renderer::GenericBuffer& valid = *mValid;
+    glm::ivec2 size(GetWidth(), GetHeight());
 
-    mParticleFromGridBound = mParticleFromGridWork.Bind({mParticles, mDispatchParams, velocity, velocity.D()});
-    mParticleFromGrid.Record([&](vk::CommandBuffer commandBuffer)
+    mParticleToGridBound.clear();
+    mParticleToGrid.clear();
+    mParticleFromGridBound.clear();
+    mParticleFromGrid.clear();
+
+    for (int parity = 0; parity < 2; parity++)
     {
-        commandBuffer.debugMarkerBeginEXT({"Particle from grid", {{ 0.35f, 0.11f, 0.87f, 1.0f}}});
-        mParticleFromGridBound.PushConstant(commandBuffer, mAlpha);
-        mParticleFromGridBound.RecordIndirect(commandBuffer, mDispatchParams);
-        mParticles.Barrier(commandBuffer, vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead);
-        commandBuffer.debugMarkerEndEXT();
-    });
+        Particles& particles = GetParticles(parity);
+
+        mParticleToGridBound.push_back(mParticleToGridWork->Bind({mCount, particles.Position, particles.Velocity, GetIndex(parity), velocity, valid, particles.Affine}));
+        mParticleToGrid.emplace_back(mDevice, false);
+        mParticleToGrid.back().Record([&, parity](vk::CommandBuffer commandBuffer)
+        {
+            commandBuffer.debugMarkerBeginEXT({"Particle to grid", {{ 0.71f, 0.15f, 0.48f, 1.0f}}});
+            valid.Clear(commandBuffer);
+            mParticleToGridBound[parity].PushConstant(commandBuffer, (int)particles.Compact, (int)particles.HasAffine);
+            mParticleToGridBound[parity].Record(commandBuffer);
+            valid.Barrier(commandBuffer, vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead);
+            commandBuffer.debugMarkerEndEXT();
+        });
+
+        mParticleFromGridBound.push_back(mParticleFromGridWork->Bind(size, {particles.Position,
+                                                                             particles.Velocity,
+                                                                             GetDispatchParams(parity),
+                                                                             velocity,
+                                                                             velocity.D(),
+                                                                             particles.Affine,
+                                                                             particles.Cell}));
+        mParticleFromGrid.emplace_back(mDevice, false);
+        mParticleFromGrid.back().Record([&, parity](vk::CommandBuffer commandBuffer)
+        {
+            commandBuffer.debugMarkerBeginEXT({"Particle from grid", {{ 0.35f, 0.11f, 0.87f, 1.0f}}});
+            mParticleFromGridBound[parity].PushConstant(commandBuffer, mAlpha, (int)particles.Compact, (int)particles.HasAffine);
+            mParticleFromGridBound[parity].RecordIndirect(commandBuffer, GetDispatchParams(parity));
+            GetParticles(parity).Velocity.Barrier(commandBuffer, vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead);
+            GetParticles(parity).Affine.Barrier(commandBuffer, vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead);
+            commandBuffer.debugMarkerEndEXT();
+        });
+    }
 }
 
 void ParticleCount::TransferToGrid()
 {
-    mParticleToGrid.Submit();
+    mParticleToGrid[mParity].Submit();
 }
 
 void ParticleCount::TransferFromGrid()
 {
-    mParticleFromGrid.Submit();
+    mParticleFromGrid[mParity].Submit();
+}
+
+ParticleSprite::ParticleSprite(const Renderer::Device& device, ParticleCount& particleCount, float size)
+    : mDevice(device)
+    , mParticleCount(particleCount)
+    , mBoundParticles()
+    , mSize(size)
+    , mMVPBuffer(device, VMA_MEMORY_USAGE_CPU_TO_GPU)
+    , mColourBuffer(device, VMA_MEMORY_USAGE_CPU_TO_GPU)
+    , mVisible(std::make_unique<Renderer::Buffer<glm::vec2>>(device, particleCount.GetCapacity()))
+    , mDrawParams(device)
+    , mLocalDrawParams(device, 1, VMA_MEMORY_USAGE_CPU_ONLY)
+    , mCullWork(device, Renderer::ComputeSize::Default1D(), SPIRV::ParticleCull_comp)
+{
+    Renderer::CopyFrom(mLocalDrawParams, vk::DrawIndirectCommand(6, 0, 0, 0));
+
+    BindCull();
+
+    SPIRV::Reflection reflectionVert(SPIRV::ParticleSprite_vert);
+    SPIRV::Reflection reflectionFrag(SPIRV::Position_frag);
+
+    mLayout = {{reflectionVert, reflectionFrag}};
+    mDescriptorSet = device.GetLayoutManager().MakeDescriptorSet(mLayout);
+    Bind(device, *mDescriptorSet.descriptorSet, mLayout, {{mMVPBuffer, 0}, {mColourBuffer, 1}, {*mVisible, 2}});
+
+    mPipeline = Renderer::GraphicsPipeline::Builder()
+            .Topology(vk::PrimitiveTopology::eTriangleList)
+            .Shader(device.GetShaderModule(SPIRV::ParticleSprite_vert), vk::ShaderStageFlagBits::eVertex)
+            .Shader(device.GetShaderModule(SPIRV::Position_frag), vk::ShaderStageFlagBits::eFragment)
+            .Layout(mDescriptorSet.pipelineLayout);
+}
+
+void ParticleSprite::BindCull()
+{
+    // The previous cull commands could still be executing, they are kept until the next rebind.
+    // Rebinds follow the reallocations of the particles, which wait on the previous one, see ParticleCount::UpdateCapacity
+    mRetiredCullBound = std::move(mCullBound);
+    mRetiredCull = std::move(mCull);
+    mCullBound.clear();
+    mCull.clear();
+
+    // The visible particles are at most all the particles. The descriptor set is bound in the recorded
+    // render commands, so it is only updated once the commands drawing the sprite have completed:
+    // the buffer is reallocated when the capacity grows past it or falls under half of it.
+    vk::DeviceSize visibleSize = sizeof(glm::vec2) * mParticleCount.GetCapacity();
+    if (mVisible->Size() < visibleSize || mVisible->Size() > 2 * visibleSize)
+    {
+        mDevice.Queue().waitIdle();
+        mRetiredCullBound.clear();
+        mRetiredCull.clear();
+
+        mVisible = std::make_unique<Renderer::Buffer<glm::vec2>>(mDevice, mParticleCount.GetCapacity());
+        Bind(mDevice, *mDescriptorSet.descriptorSet, mLayout, {{mMVPBuffer, 0}, {mColourBuffer, 1}, {*mVisible, 2}});
+    }
+
+    glm::ivec2 size(mParticleCount.GetWidth(), mParticleCount.GetHeight());
+
+    for (int parity = 0; parity < 2; parity++)
+    {
+        Particles& particles = mParticleCount.GetParticles(parity);
+        mBoundParticles[parity] = &particles;
+
+        mCullBound.push_back(mCullWork.Bind(size, {particles.Position,
+                                                   mParticleCount.GetDispatchParams(parity),
+                                                   mMVPBuffer,
+                                                   *mVisible,
+                                                   mDrawParams,
+                                                   particles.Cell}));
+        mCull.emplace_back(mDevice, false);
+        mCull.back().Record([&, parity](vk::CommandBuffer commandBuffer)
+        {
+            commandBuffer.debugMarkerBeginEXT({"Particle cull", {{ 0.33f, 0.61f, 0.84f, 1.0f}}});
+            mDrawParams.CopyFrom(commandBuffer, mLocalDrawParams);
+            mCullBound[parity].PushConstant(commandBuffer, (int)particles.Compact, mSize);
+            mCullBound[parity].RecordIndirect(commandBuffer, mParticleCount.GetDispatchParams(parity));
+            mVisible->Barrier(commandBuffer, vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead);
+            mDrawParams.Barrier(commandBuffer, vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eIndirectCommandRead);
+            commandBuffer.debugMarkerEndEXT();
+        });
+    }
+}
+
+void ParticleSprite::Initialize(const Renderer::RenderState& renderState)
+{
+    mPipeline.Create(mDevice.Handle(), renderState);
+}
+
+void ParticleSprite::Update(const glm::mat4& projection, const glm::mat4& view)
+{
+    if (mBoundParticles[0] != &mParticleCount.GetParticles(0) ||
+        mBoundParticles[1] != &mParticleCount.GetParticles(1))
+    {
+        BindCull();
+    }
+
+    Renderer::CopyFrom(mColourBuffer, Colour);
+    Renderer::CopyFrom(mMVPBuffer, projection * view * GetTransform());
+
+    // Submitted before the render command drawing the sprite
+    mCull[mParticleCount.GetParity()].Submit();
+}
+
+void ParticleSprite::Draw(vk::CommandBuffer commandBuffer, const Renderer::RenderState& renderState)
+{
+    mPipeline.Bind(commandBuffer, renderState);
+    commandBuffer.pushConstants(mDescriptorSet.pipelineLayout, vk::ShaderStageFlagBits::eVertex, 0, 4, &mSize);
+    commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics,
+                                     mDescriptorSet.pipelineLayout, 0, {*mDescriptorSet.descriptorSet}, {});
+    commandBuffer.drawIndirect(mDrawParams.Handle(), 0, 1, 0);
 }
 
 }}
@@ -8,29 +8,151 @@
 
 #include <Vortex2D/Renderer/Buffer.h>
 #include <Vortex2D/Renderer/RenderTexture.h>
+#include <Vortex2D/Renderer/Drawable.h>
+#include <Vortex2D/Renderer/Transformable.h>
+#include <Vortex2D/Renderer/Pipeline.h>
+#include <Vortex2D/Renderer/DescriptorSet.h>
 #include <Vortex2D/Engine/PrefixScan.h>
 #include <Vortex2D/Engine/Velocity.h>
 
+#include <array>
+#include <memory>
+
 namespace Vortex2D { namespace Fluid {
 
 class LevelSet;
 
-struct Particle
+/**
+ * @brief Particles stored as a structure of arrays: the positions and velocities are in separate buffers,
+ * with an optional buffer of attributes. Kernels only bind the streams they need.
+ * In the compact format, a position is the offset from the cell the particle is sorted in, as two 16 bit
+ * fixed point values, and a velocity is two half floats, i.e. one vec2 holds the positions or the velocities
+ * of two particles. The cell of each particle is stored in a separate buffer, as two 16 bit values, and
+ * written when the particles are sorted, so compact particles can only be added by the scan of a @ref ParticleCount.
+ * A compact particle is 12 bytes (position, cell and velocity) instead of 16: the velocities are half
+ * the size, and so are the positions read by the kernels iterating over the particles of each cell,
+ * e.g. the particle to grid transfer, which don't need the cell.
+ * With affine velocities, each particle also stores the gradient of its velocity (APIC transfers).
+ */
+struct Particles
+{
+    /**
+     * @brief Allocate the particle buffers.
+     * @param device vulkan device
+     * @param capacity the maximum number of particles
+     * @param attributes if the attribute buffer is used, otherwise it has a size of 1
+     * @param compact if the particles are stored in the compact format
+     * @param affine if the affine velocity buffer is used, in which case the transfers to and from
+     * the grid use APIC instead of PIC/FLIP. Otherwise it has a size of 1
+     * @param memoryUsage the memory usage of the buffers, e.g. CPU only for testing
+     */
+    VORTEX2D_API Particles(const Renderer::Device& device,
+                           int capacity,
+                           bool attributes = false,
+                           bool compact = false,
+                           bool affine = false,
+                           VmaMemoryUsage memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY);
+
+    /**
+     * @brief Copy the particles, the attributes and affine velocities are only copied if used.
+     * If the capacities differ, only the particles fitting in both are copied.
+     * @param commandBuffer command buffer to record into
+     * @param particles the source particles
+     */
+    VORTEX2D_API void CopyFrom(vk::CommandBuffer commandBuffer, Particles& particles);
+
+    /**
+     * @brief Inserts a barrier for all the used buffers.
+     * @param commandBuffer command buffer to record into
+     * @param oldAccess old access
+     * @param newAccess new access
+     */
+    VORTEX2D_API void Barrier(vk::CommandBuffer commandBuffer, vk::AccessFlags oldAccess, vk::AccessFlags newAccess);
+
+    int Capacity;
+    bool HasAttributes;
+    bool Compact;
+    bool HasAffine;
+    VmaMemoryUsage MemoryUsage;
+    Renderer::Buffer<glm::vec2> Position;
+    Renderer::Buffer<glm::vec2> Velocity;
+    Renderer::Buffer<uint32_t> Cell;
+    Renderer::Buffer<glm::vec4> Attribute;
+    Renderer::Buffer<glm::vec4> Affine;
+};
+
+/**
+ * @brief Policy used to grow or shrink the capacity of the particle buffers, see @ref ParticleCount::UpdateCapacity.
+ */
+struct ParticleCapacityPolicy
+{
+    /**
+     * @brief Grow when the number of particles requested, including the pending ones, goes above this fraction of the capacity.
+     */
+    float GrowThreshold = 0.9f;
+
+    /**
+     * @brief Shrink when the high-water mark goes below this fraction of the capacity.
+     */
+    float ShrinkThreshold = 0.25f;
+
+    /**
+     * @brief The new capacity is the number of particles multiplied by this factor.
+     */
+    float Headroom = 2.0f;
+
+    /**
+     * @brief The capacity never goes below this.
+     */
+    int MinCapacity = 1024;
+};
+
+/**
+ * @brief A shape adding or removing particles in the cells whose centre it covers, see @ref ParticleCount::SetEmitters.
+ */
+struct ParticleEmitter
 {
-  alignas(8) glm::vec2 Position;
-  alignas(8) glm::vec2 Velocity;
+    enum class Shape : int32_t
+    {
+        Box = 0,
+        Circle = 1
+    };
+
+    /**
+     * @brief The top left corner of a box, or the centre of a circle.
+     */
+    glm::vec2 Position;
+
+    /**
+     * @brief The size of a box, or the radius of a circle in x.
+     */
+    glm::vec2 Size;
+
+    /**
+     * @brief The number of particles added per cell at each scan, negative to remove particles (a sink).
+     * The fractional part is the probability of adding one more particle.
+     */
+    float Rate;
+
+    Shape Type;
 };
 
 /**
  * @brief Container for particles used in the advection of the fluid simulation.
  * Also a level set that is built from the particles.
+ * The particles are double buffered: each scan sorts them from the current buffer into the other one,
+ * which then becomes current. The given particles are the first buffer, see @ref GetParticles.
+ * The capacity of the buffers can be changed between steps, after which the buffers are owned by
+ * this class and the given particles are no longer used. No particle is dropped: when the particles
+ * added by a scan don't fit in the capacity, they are kept pending until it grows, while the
+ * particles removed are removed right away.
  */
 class ParticleCount : public Renderer::RenderTexture
 {
 public:
     VORTEX2D_API ParticleCount(const Renderer::Device& device,
                                const glm::ivec2& size,
-                               Renderer::GenericBuffer& particles,
+                               Particles& particles,
                                const Renderer::DispatchParams& params = {0},
                                float alpha = 1.0f);
 
@@ -40,17 +162,116 @@ public:
     VORTEX2D_API void Scan();
 
     /**
-     * @brief Calculate the total number of particles and return it.
+     * @brief Set the emitters and sinks applied by the next scan, in addition to the shapes drawn
+     * on this render target. They are uploaded in a single copy and applied by a single dispatch,
+     * where each tile of cells only tests the emitters overlapping it.
+     * @param emitters list of at most @ref MaxEmitters emitters
+     */
+    VORTEX2D_API void SetEmitters(const std::vector<ParticleEmitter>& emitters);
+
+    /**
+     * @brief The maximum number of emitters given to @ref SetEmitters.
+     */
+    static const int MaxEmitters = 1024;
+
+    /**
+     * @brief Seed the random number generator used to place the spawned particles.
+     * It is seeded randomly at construction, a fixed seed makes the spawning reproducible.
+     * @param seed the seed
+     */
+    VORTEX2D_API void SetSeed(uint32_t seed);
+
+    /**
+     * @brief Calculate the total number of particles and return it. This waits for the count to be read back.
      * @return
      */
     VORTEX2D_API int GetTotalCount();
 
     /**
-     * @brief Calculate the dispatch parameters to use on the particle buffer
+     * @brief The total number of particles of the most recent scan whose copy to the host has completed.
+     * Non-blocking: each scan copies its count to a small ring of host buffers, so the value is
+     * typically one or two scans old. When all the copies of the ring are still in flight, the scan doesn't copy its count.
+     * @return the number of particles, or -1 if no copy has completed yet
+     */
+    VORTEX2D_API int GetLatestTotalCount();
+
+    /**
+     * @brief The capacity of the particle buffers.
+     * @return
+     */
+    VORTEX2D_API int GetCapacity();
+
+    /**
+     * @brief The highest number of particles requested by the scans, including the pending ones,
+     * read since the last capacity change.
+     * @return
+     */
+    VORTEX2D_API int GetHighWaterMark() const;
+
+    /**
+     * @brief Set the capacity of the particle buffers. A larger capacity reallocates the buffers and copies
+     * the particles on the device. A smaller capacity first limits the particles added by the scans,
+     * the buffers are then reallocated by @ref UpdateCapacity once the particles fit.
+     * The bindings of this class are redone, but the particle buffers bound elsewhere (e.g. @ref Advection)
+     * need to be bound again. The previous bindings are released after the next reallocation,
+     * which waits for this one to complete.
+     * @param capacity the new capacity, at most 8 particles per cell
+     */
+    VORTEX2D_API void SetCapacity(int capacity);
+
+    /**
+     * @brief Set the policy used by @ref UpdateCapacity.
+     * @param policy
+     */
+    VORTEX2D_API void SetCapacityPolicy(const ParticleCapacityPolicy& policy);
+
+    /**
+     * @brief Grow or shrink the capacity according to the policy, using the latest particle count.
+     * To be called between steps, it doesn't wait for the device.
+     * @return true if the particle buffers were reallocated and need to be bound again.
+     */
+    VORTEX2D_API bool UpdateCapacity();
+
+    /**
+     * @brief Calculate the dispatch parameters to use on the current particle buffer
      * @return
      */
     VORTEX2D_API Renderer::IndirectBuffer<Renderer::DispatchParams>& GetDispatchParams();
 
+    /**
+     * @brief The dispatch parameters of the particle buffer of the given parity.
+     * @param parity 0 or 1
+     * @return
+     */
+    VORTEX2D_API Renderer::IndirectBuffer<Renderer::DispatchParams>& GetDispatchParams(int parity);
+
+    /**
+     * @brief The index of the first particle of each cell in the particle buffer of the given parity,
+     * i.e. the prefix scan of the scan that sorted them.
+     * @param parity 0 or 1
+     * @return
+     */
+    VORTEX2D_API Renderer::Buffer<int>& GetIndex(int parity);
+
+    /**
+     * @brief The particle buffer containing the particles after the last scan.
+     * @return
+     */
+    VORTEX2D_API Particles& GetParticles();
+
+    /**
+     * @brief The particle buffer of the given parity, 0 is the particles given in the constructor.
+     * @param parity 0 or 1
+     * @return
+     */
+    VORTEX2D_API Particles& GetParticles(int parity);
+
+    /**
+     * @brief The parity of the current particle buffer, flipped by each scan.
+     * @return 0 or 1
+     */
+    VORTEX2D_API int GetParity() const;
+
     /**
      * @brief Bind a solid level set, which will be used to interpolate the particles out of.
      * @param levelSet
@@ -80,40 +301,133 @@ public:
     VORTEX2D_API void TransferFromGrid();
 
 private:
+    void BindScan();
+    void BindLevelSet();
+    void BindVelocities();
+    void SetCapacityLimit(int capacity);
+    void Reallocate(int capacity);
+
+    template<typename T>
+    void Retire(std::vector<T>& objects);
+
     const Renderer::Device& mDevice;
-    Renderer::GenericBuffer& mParticles;
-    Renderer::Buffer<Particle> mNewParticles;
-    Renderer::Buffer<int> mDelta, mCount;
-    Renderer::Buffer<int> mIndex;
-    Renderer::Buffer<glm::ivec2> mSeeds;
+    glm::ivec2 mSize;
+    std::vector<std::unique_ptr<Particles>> mOwnedParticles;
+    std::array<Particles*, 2> mParticleBuffers;
+    Renderer::Buffer<int> mDelta, mCount, mPending;
+    Renderer::Buffer<int> mIndex, mBackIndex, mCountIndex;
+    Renderer::Buffer<uint32_t> mRandomState;
+    Renderer::Buffer<ParticleEmitter> mEmitters, mLocalEmitters;
+    Renderer::Buffer<int> mEmitterCount, mLocalEmitterCount;
+    Renderer::CommandBuffer mEmitterUpload;
 
-    Renderer::IndirectBuffer<Renderer::DispatchParams> mDispatchParams;
-    Renderer::Buffer<Renderer::DispatchParams> mLocalDispatchParams, mNewDispatchParams;
+    Renderer::IndirectBuffer<Renderer::DispatchParams> mDispatchParams, mBackDispatchParams;
+    Renderer::IndirectBuffer<Renderer::DispatchParams> mRequestedParams, mCountParams;
+    Renderer::Buffer<Renderer::DispatchParams> mLocalDispatchParams;
+    Renderer::Buffer<int> mCapacityLimit, mLocalCapacityLimit;
+    Renderer::CommandBuffer mCapacityUpload;
 
+    // The bounds and command buffers below are indexed by the parity of the particles they read
     Renderer::Work mParticleCountWork;
-    Renderer::Work::Bound mParticleCountBound;
+    std::vector<Renderer::Work::Bound> mParticleCountBound;
+    Renderer::Work mParticleEmitWork;
+    Renderer::Work::Bound mParticleEmitBound;
 	Renderer::Work mParticleClampWork;
 	Renderer::Work::Bound mParticleClampBound;
     PrefixScan mPrefixScan;
-    PrefixScan::Bound mPrefixScanBound;
+    std::vector<PrefixScan::Bound> mPrefixScanBound;
+    PrefixScan mCountPrefixScan;
+    PrefixScan::Bound mCountPrefixScanBound;
+    Renderer::Work mParticleCapacityWork;
+    std::vector<Renderer::Work::Bound> mParticleCapacityBound;
     Renderer::Work mParticleBucketWork;
-    Renderer::Work::Bound mParticleBucketBound;
+    std::vector<Renderer::Work::Bound> mParticleBucketBound;
     Renderer::Work mParticleSpawnWork;
-    Renderer::Work::Bound mParticleSpawnBound;
+    std::vector<Renderer::Work::Bound> mParticleSpawnBound;
     Renderer::Work mParticlePhiWork;
-    Renderer::Work::Bound mParticlePhiBound;
-    Renderer::Work mParticleToGridWork;
-    Renderer::Work::Bound mParticleToGridBound;
-    Renderer::Work mParticleFromGridWork;
-    Renderer::Work::Bound mParticleFromGridBound;
-
-    Renderer::CommandBuffer mScanWork;
-    Renderer::CommandBuffer mDispatchCountWork;
-    Renderer::CommandBuffer mParticlePhi;
-    Renderer::CommandBuffer mParticleToGrid;
-    Renderer::CommandBuffer mParticleFromGrid;
+    std::vector<Renderer::Work::Bound> mParticlePhiBound;
+    std::unique_ptr<Renderer::Work> mParticleToGridWork;
+    std::vector<Renderer::Work::Bound> mParticleToGridBound;
+    std::unique_ptr<Renderer::Work> mParticleFromGridWork;
+    std::vector<Renderer::Work::Bound> mParticleFromGridBound;
+
+    std::vector<Renderer::CommandBuffer> mScanWork;
+    std::vector<Renderer::CommandBuffer> mDispatchCountWork;
+    std::vector<Renderer::CommandBuffer> mParticlePhi;
+    std::vector<Renderer::CommandBuffer> mParticleToGrid;
+    std::vector<Renderer::CommandBuffer> mParticleFromGrid;
+
+    // Ring of host buffers the count and requested count are copied to after each scan,
+    // the command buffers are indexed by slot and parity
+    std::vector<Renderer::Buffer<Renderer::DispatchParams>> mCountReadbacks, mRequestedReadbacks;
+    std::vector<Renderer::CommandBuffer> mCountReadCmds;
+    std::vector<int> mCountScans;
+    std::vector<bool> mCountPending;
+    std::size_t mCountWriteIndex;
+    int mScanNumber;
+    int mLatestCount, mLatestRequested, mLatestScan;
 
+    // The scans from mTargetScan don't add particles beyond mTargetCapacity,
+    // which is lower than the capacity of the buffers while shrinking
+    ParticleCapacityPolicy mCapacityPolicy;
+    int mHighWaterMark;
+    int mTargetCapacity;
+    int mTargetScan;
+
+    LevelSet* mLevelSet;
+    Velocity* mVelocity;
+    Renderer::GenericBuffer* mValid;
+
+    int mParity;
     float mAlpha;
+
+    // Objects bound to the previous particle buffers, destroyed after the reallocation completed
+    std::vector<std::shared_ptr<void>> mRetired;
+    Renderer::CommandBuffer mResizeCmd;
+};
+
+/**
+ * @brief Draws the particles of a @ref ParticleCount as instanced squares, without reading them back.
+ * Each time it is rendered, a compute pass culls the particles outside the view and
+ * the number of squares drawn comes from the GPU with an indirect draw.
+ */
+class ParticleSprite : public Renderer::Drawable, public Renderer::Transformable
+{
+public:
+    /**
+     * @brief Initialize the sprite with the particles to draw.
+     * @param device vulkan device
+     * @param particleCount the particles, rebound automatically when their capacity changes
+     * @param size the width of the square drawn for each particle
+     */
+    VORTEX2D_API ParticleSprite(const Renderer::Device& device, ParticleCount& particleCount, float size = 1.0f);
+
+    void Initialize(const Renderer::RenderState& renderState) override;
+    void Update(const glm::mat4& projection, const glm::mat4& view) override;
+    void Draw(vk::CommandBuffer commandBuffer, const Renderer::RenderState& renderState) override;
+
+    glm::vec4 Colour = {1.0f, 1.0f, 1.0f, 1.0f};
+
+private:
+    void BindCull();
+
+    const Renderer::Device& mDevice;
+    ParticleCount& mParticleCount;
+    std::array<Particles*, 2> mBoundParticles;
+    float mSize;
+    Renderer::UniformBuffer<glm::mat4> mMVPBuffer;
+    Renderer::UniformBuffer<glm::vec4> mColourBuffer;
+    std::unique_ptr<Renderer::Buffer<glm::vec2>> mVisible;
+    Renderer::IndirectBuffer<vk::DrawIndirectCommand> mDrawParams;
+    Renderer::Buffer<vk::DrawIndirectCommand> mLocalDrawParams;
+    Renderer::Work mCullWork;
+    std::vector<Renderer::Work::Bound> mCullBound;
+    std::vector<Renderer::CommandBuffer> mCull;
+    std::vector<Renderer::Work::Bound> mRetiredCullBound;
+    std::vector<Renderer::CommandBuffer> mRetiredCull;
+    Renderer::PipelineLayout mLayout;
+    Renderer::DescriptorSet mDescriptorSet;
+    Renderer::GraphicsPipeline mPipeline;
 };
 
 }}
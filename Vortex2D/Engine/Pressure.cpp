@@ -25,14 +25,15 @@ Pressure::Pressure(const Renderer::Device& device,
                                            data.Lower,
                                            liquidPhi,
                                            solidPhi}))
-    , mBuildDiv(device, size, SPIRV::BuildDiv_comp)
+    , mBuildDiv(device, size, velocity.SelectSpirv(SPIRV::BuildDiv_comp, SPIRV::BuildDivHalf_comp))
     , mBuildDivBound(mBuildDiv.Bind({data.B,
                                      data.Diagonal,
                                      liquidPhi,
                                      solidPhi,
                                      velocity}))
-    , mProject(device, size, SPIRV::Project_comp)
-    , mProjectBound(mProject.Bind({data.X, liquidPhi, solidPhi, velocity, velocity.Output(), valid}))
+    , mProject(device, size, velocity.SelectSpirv(SPIRV::Project_comp, SPIRV::ProjectHalf_comp))
+    // Each velocity is only read by the invocation writing it, so the projection is done in place
+    , mProjectBound(mProject.Bind({data.X, liquidPhi, solidPhi, velocity, velocity, valid}))
     , mBuildEquationCmd(device, false)
     , mProjectCmd(device, false)
 {
@@ -54,7 +55,9 @@ Pressure::Pressure(const Renderer::Device& device,
         valid.Clear(commandBuffer);
         mProjectBound.PushConstant(commandBuffer, dt);
         mProjectBound.Record(commandBuffer);
-        velocity.CopyBack(commandBuffer);
+        velocity.Barrier(commandBuffer,
+                         vk::ImageLayout::eGeneral, vk::AccessFlagBits::eShaderWrite,
+                         vk::ImageLayout::eGeneral, vk::AccessFlagBits::eShaderRead);
         commandBuffer.debugMarkerEndEXT();
     });
 
@@ -0,0 +1,108 @@
+//
+//  Probes.cpp
+//  Vortex2D
+//
+
+#include "Probes.h"
+
+#include <Vortex2D/Renderer/Pipeline.h>
+
+#include "vortex2d_generated_spirv.h"
+
+namespace Vortex2D { namespace Fluid {
+
+Probes::Probes(const Renderer::Device& device,
+               Velocity& velocity,
+               Renderer::Texture& liquidPhi,
+               Renderer::Texture& solidPhi,
+               unsigned capacity,
+               unsigned ringSize)
+    : mCapacity(capacity)
+    , mLinearFilter(Renderer::IsLinearFilterSupported(device, velocity.GetFormat()) &&
+                    Renderer::IsLinearFilterSupported(device, liquidPhi.GetFormat()) &&
+                    Renderer::IsLinearFilterSupported(device, solidPhi.GetFormat()))
+    , mSampler(Renderer::SamplerBuilder()
+               .AddressMode(vk::SamplerAddressMode::eClampToEdge)
+               .Filter(mLinearFilter ? vk::Filter::eLinear : vk::Filter::eNearest)
+               .Create(device.Handle()))
+    , mSampleWork(device,
+                  Renderer::ComputeSize(static_cast<int>(capacity)),
+                  SPIRV::SampleProbes_comp,
+                  Renderer::SpecConst(Renderer::SpecConstValue(3, mLinearFilter ? 1 : 0)))
+    , mCounts(ringSize, 0)
+    , mWriteIndex(0)
+    , mReadIndex(0)
+    , mPending(0)
+{
+    for (unsigned i = 0; i < ringSize; i++)
+    {
+        mLocalPoints.emplace_back(device, capacity, VMA_MEMORY_USAGE_CPU_TO_GPU);
+        mLocalSamples.emplace_back(device, capacity, VMA_MEMORY_USAGE_GPU_TO_CPU);
+        mSampleCmds.emplace_back(device, true);
+    }
+
+    for (unsigned i = 0; i < ringSize; i++)
+    {
+        mSampleBound.push_back(mSampleWork.Bind({mLocalPoints[i],
+                                                 mLocalSamples[i],
+                                                 {*mSampler, velocity},
+                                                 {*mSampler, liquidPhi},
+                                                 {*mSampler, solidPhi}}));
+    }
+}
+
+void Probes::Sample(const std::vector<glm::vec2>& points)
+{
+    if (points.size() > mCapacity) throw std::runtime_error("Too many probes");
+
+    // Wait for the previous sampling using these buffers, only when its samples are dropped
+    mSampleCmds[mWriteIndex].Wait();
+
+    std::vector<glm::vec2> localPoints(points);
+    localPoints.resize(mCapacity);
+    Renderer::CopyFrom(mLocalPoints[mWriteIndex], localPoints);
+
+    int count = static_cast<int>(points.size());
+    mCounts[mWriteIndex] = count;
+
+    unsigned index = mWriteIndex;
+    mSampleCmds[index].Record([&, index, count](vk::CommandBuffer commandBuffer)
+    {
+        commandBuffer.debugMarkerBeginEXT({"Sample probes", {{ 0.18f, 0.80f, 0.62f, 1.0f}}});
+        mSampleBound[index].PushConstant(commandBuffer, count);
+        mSampleBound[index].Record(commandBuffer);
+        mLocalSamples[index].Barrier(commandBuffer, vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eHostRead);
+        commandBuffer.debugMarkerEndEXT();
+    });
+    mSampleCmds[index].Submit();
+
+    mWriteIndex = (mWriteIndex + 1) % mSampleCmds.size();
+
+    if (mPending == mSampleCmds.size())
+    {
+        mReadIndex = (mReadIndex + 1) % mSampleCmds.size();
+    }
+    else
+    {
+        mPending++;
+    }
+}
+
+bool Probes::Read(std::vector<ProbeSample>& samples)
+{
+    if (mPending == 0 || !mSampleCmds[mReadIndex].IsFinished())
+    {
+        return false;
+    }
+
+    samples.resize(mCapacity);
+    Renderer::CopyTo(mLocalSamples[mReadIndex], samples);
+    samples.resize(mCounts[mReadIndex]);
+
+    mReadIndex = (mReadIndex + 1) % mSampleCmds.size();
+    mPending--;
+
+    return true;
+}
+
+}}
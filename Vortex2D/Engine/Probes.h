@@ -0,0 +1,94 @@
+//
+//  Probes.h
+//  Vortex2D
+//
+
+#ifndef Vortex2d_Probes_h
+#define Vortex2d_Probes_h
+
+#include <Vortex2D/Renderer/Work.h>
+#include <Vortex2D/Renderer/Buffer.h>
+#include <Vortex2D/Renderer/Texture.h>
+#include <Vortex2D/Renderer/CommandBuffer.h>
+#include <Vortex2D/Engine/Velocity.h>
+
+#include <vector>
+
+namespace Vortex2D { namespace Fluid {
+
+/**
+ * @brief The fields sampled at a point, see @ref Probes::Sample.
+ */
+struct ProbeSample
+{
+    /**
+     * @brief The velocity, with the same scale as the colour drawn with @ref World::RecordVelocity.
+     */
+    glm::vec2 Velocity;
+
+    /**
+     * @brief The liquid level set, negative inside the liquid.
+     */
+    float LiquidPhi;
+
+    /**
+     * @brief The solid level set, negative inside the solids.
+     */
+    float SolidPhi;
+};
+
+/**
+ * @brief Samples the velocity and level sets at a list of points, without reading back the fields.
+ * The points and samples are in a small ring of host visible buffers, read and written directly by a single dispatch,
+ * so the samples can be read later without stalling the simulation.
+ */
+class Probes
+{
+public:
+    /**
+     * @brief Initialize the probes with a capacity and ring size.
+     * @param device vulkan device
+     * @param velocity the velocity field
+     * @param liquidPhi the liquid level set
+     * @param solidPhi the solid level set
+     * @param capacity maximum number of points sampled at once
+     * @param ringSize number of samplings that can be pending a read
+     */
+    VORTEX2D_API Probes(const Renderer::Device& device,
+                        Velocity& velocity,
+                        Renderer::Texture& liquidPhi,
+                        Renderer::Texture& solidPhi,
+                        unsigned capacity = 4096,
+                        unsigned ringSize = 3);
+
+    /**
+     * @brief Sample the fields at the points. Non-blocking.
+     * If all the host buffers are pending a read, the oldest samples are dropped.
+     * @param points positions in cells, (0,0) is the corner of the domain. At most capacity points.
+     */
+    VORTEX2D_API void Sample(const std::vector<glm::vec2>& points);
+
+    /**
+     * @brief Read the samples of the oldest call to @ref Sample, if it has completed. Non-blocking.
+     * @param samples the samples, in the same order as the points.
+     * @return true if samples were read.
+     */
+    VORTEX2D_API bool Read(std::vector<ProbeSample>& samples);
+
+private:
+    unsigned mCapacity;
+    bool mLinearFilter;
+    vk::UniqueSampler mSampler;
+    Renderer::Work mSampleWork;
+
+    std::vector<Renderer::Buffer<glm::vec2>> mLocalPoints;
+    std::vector<Renderer::Buffer<ProbeSample>> mLocalSamples;
+    std::vector<Renderer::Work::Bound> mSampleBound;
+    std::vector<Renderer::CommandBuffer> mSampleCmds;
+    std::vector<int> mCounts;
+    unsigned mWriteIndex, mReadIndex, mPending;
+};
+
+}}
+
+#endif
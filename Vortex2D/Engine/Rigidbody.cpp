@@ -38,11 +38,9 @@ RigidBody::RigidBody(const Renderer::Device& device,
     , mLocalVelocity(device, VMA_MEMORY_USAGE_CPU_ONLY)
     , mClear({1000.0f, 0.0f, 0.0f, 0.0f})
     , mDiv(device, size, SPIRV::BuildRigidbodyDiv_comp)
-    , mConstrain(device, size, SPIRV::ConstrainRigidbodyVelocity_comp)
     , mForceWork(device, size, SPIRV::RigidbodyForce_comp)
     , mPressureWork(device, size, SPIRV::RigidbodyPressure_comp)
     , mDivCmd(device, false)
-    , mConstrainCmd(device, false)
     , mForceCmd(device, true)
     , mPressureCmd(device, false)
     , mVelocityCmd(device, false)
@@ -96,28 +94,20 @@ void RigidBody::RenderPhi()
 }
 
 void RigidBody::BindDiv(Renderer::GenericBuffer& div,
-                        Renderer::GenericBuffer& diagonal)
+                        Renderer::GenericBuffer& diagonal,
+                        Renderer::GenericBuffer& constraints,
+                        Renderer::GenericBuffer& constraintIds,
+                        int index)
 {
-    mDivBound = mDiv.Bind({div, diagonal , mPhi, mVelocity, mMVBuffer});
-    mDivCmd.Record([&](vk::CommandBuffer commandBuffer)
+    mDivBound = mDiv.Bind({div, diagonal , mPhi, mVelocity, mMVBuffer, constraints, constraintIds});
+    mDivCmd.Record([&, index](vk::CommandBuffer commandBuffer)
     {
         commandBuffer.debugMarkerBeginEXT({"Rigidbody build equation", {{0.90f, 0.27f, 0.28f, 1.0f}}});
-        mDivBound.PushConstant(commandBuffer, mCentre);
+        mDivBound.PushConstant(commandBuffer, mCentre, index);
         mDivBound.Record(commandBuffer);
         div.Barrier(commandBuffer, vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead);
-        commandBuffer.debugMarkerEndEXT();
-    });
-}
-
-void RigidBody::BindVelocityConstrain(Fluid::Velocity& velocity)
-{
-    mConstrainBound = mConstrain.Bind({velocity, velocity.Output(), mPhi, mVelocity, mMVBuffer});
-    mConstrainCmd.Record([&](vk::CommandBuffer commandBuffer)
-    {
-        commandBuffer.debugMarkerBeginEXT({"Rigidbody constrain", {{0.29f, 0.36f, 0.21f, 1.0f}}});
-        mConstrainBound.PushConstant(commandBuffer, mCentre);
-        mConstrainBound.Record(commandBuffer);
-        velocity.CopyBack(commandBuffer);
+        constraints.Barrier(commandBuffer, vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead);
+        constraintIds.Barrier(commandBuffer, vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead);
         commandBuffer.debugMarkerEndEXT();
     });
 }
@@ -176,11 +166,6 @@ void RigidBody::Pressure()
     mPressureCmd.Submit();
 }
 
-void RigidBody::VelocityConstrain()
-{
-    mConstrainCmd.Submit();
-}
-
 vk::Flags<RigidBody::Type> RigidBody::GetType()
 {
     return mType;
@@ -38,6 +38,16 @@ public:
         alignas(4) float angular_velocity;
     };
 
+    /**
+     * @brief Velocity and centre of a static body, as used by the velocity constraint of @ref Extrapolation.
+     */
+    struct Constraint
+    {
+        alignas(8) glm::vec2 velocity;
+        alignas(8) glm::vec2 centre;
+        alignas(4) float angular_velocity;
+    };
+
     VORTEX2D_API RigidBody(const Renderer::Device& device,
                            const glm::ivec2& size,
                            float dt,
@@ -68,18 +78,18 @@ public:
     /**
      * @brief Bind a the right hand side and diagonal of the linear system Ax = b.
      * This is to apply the rigid body influence to the system.
+     * The body also writes its @ref Constraint and its index in the cells it covers, for the velocity constraint.
      * @param div right hand side of the linear system Ax=b
      * @param diagonal diagonal of matrix A
-     * @param fluidLevelSet fluid level set
+     * @param constraints buffer of @ref Constraint, indexed by body
+     * @param constraintIds buffer of the index plus one of the body covering each cell, 0 if none
+     * @param index index of this body in the constraints
      */
     VORTEX2D_API void BindDiv(Renderer::GenericBuffer& div,
-                              Renderer::GenericBuffer& diagonal);
-
-    /**
-     * @brief Bind velocities to constrain based on the body's velocity.
-     * @param velocity
-     */
-    VORTEX2D_API void BindVelocityConstrain(Fluid::Velocity& velocity);
+                              Renderer::GenericBuffer& diagonal,
+                              Renderer::GenericBuffer& constraints,
+                              Renderer::GenericBuffer& constraintIds,
+                              int index);
 
     /**
      * @brief Bind pressure, to have the pressure update the body's forces
@@ -114,11 +124,6 @@ public:
      */
     VORTEX2D_API void Pressure();
 
-    /**
-     * @brief Constrain the velocities field based on the body's velocity.
-     */
-    VORTEX2D_API void VelocityConstrain();
-
     /**
      * @brief Download the forces from the GPU and return them.
      * @return
@@ -153,9 +158,9 @@ private:
     Renderer::Clear mClear;
     Renderer::RenderCommand mLocalPhiRender, mPhiRender;
 
-    Renderer::Work mDiv, mConstrain, mForceWork, mPressureWork;
-    Renderer::Work::Bound mDivBound, mConstrainBound, mForceBound, mPressureForceBound, mPressureBound;
-    Renderer::CommandBuffer mDivCmd, mConstrainCmd, mForceCmd, mPressureCmd, mVelocityCmd;
+    Renderer::Work mDiv, mForceWork, mPressureWork;
+    Renderer::Work::Bound mDivBound, mForceBound, mPressureForceBound, mPressureBound;
+    Renderer::CommandBuffer mDivCmd, mForceCmd, mPressureCmd, mVelocityCmd;
     ReduceJ mSum;
     ReduceSum::Bound mLocalSumBound, mSumBound;
 
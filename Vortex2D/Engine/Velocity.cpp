@@ -9,14 +9,25 @@
 
 namespace Vortex2D { namespace Fluid {
 
-Velocity::Velocity(const Renderer::Device& device, const glm::ivec2& size)
-    : Renderer::RenderTexture(device, size.x, size.y, vk::Format::eR32G32Sfloat)
-    , mOutputVelocity(device, size.x, size.y, vk::Format::eR32G32Sfloat)
-    , mDVelocity(device, size.x, size.y, vk::Format::eR32G32Sfloat)
-    , mVelocityDiff(device, size, SPIRV::VelocityDifference_comp)
+namespace
+{
+vk::Format GetVelocityFormat(Velocity::Precision precision)
+{
+    return precision == Velocity::Precision::Half ? vk::Format::eR16G16Sfloat : vk::Format::eR32G32Sfloat;
+}
+}
+
+Velocity::Velocity(const Renderer::Device& device, const glm::ivec2& size, Precision precision)
+    : Renderer::RenderTexture(device, size.x, size.y, GetVelocityFormat(precision))
+    , mPrecision(precision)
+    , mParity(0)
+    , mOutputVelocity(device, size.x, size.y, GetVelocityFormat(precision))
+    , mDVelocity(device, size.x, size.y, GetVelocityFormat(precision))
+    , mVelocityDiff(device, size, SelectSpirv(SPIRV::VelocityDifference_comp, SPIRV::VelocityDifferenceHalf_comp))
     , mVelocityDiffBound(mVelocityDiff.Bind({mDVelocity, *this, mOutputVelocity}))
     , mSaveCopyCmd(device, false)
     , mVelocityDiffCmd(device, false)
+    , mResolveCmd(device, false)
 {
     mSaveCopyCmd.Record([&](vk::CommandBuffer commandBuffer)
     {
@@ -33,6 +44,22 @@ Velocity::Velocity(const Renderer::Device& device, const glm::ivec2& size)
         mDVelocity.CopyFrom(commandBuffer, mOutputVelocity);
         commandBuffer.debugMarkerEndEXT();
     });
+
+    mResolveCmd.Record([&](vk::CommandBuffer commandBuffer)
+    {
+        CopyBack(commandBuffer);
+    });
+}
+
+Velocity::Precision Velocity::GetPrecision() const
+{
+    return mPrecision;
+}
+
+const Renderer::SpirvBinary& Velocity::SelectSpirv(const Renderer::SpirvBinary& full,
+                                                   const Renderer::SpirvBinary& half) const
+{
+    return mPrecision == Precision::Half ? half : full;
 }
 
 Renderer::Texture& Velocity::Output()
@@ -40,6 +67,35 @@ Renderer::Texture& Velocity::Output()
     return mOutputVelocity;
 }
 
+Renderer::Texture& Velocity::Input(int parity)
+{
+    return parity == 0 ? static_cast<Renderer::Texture&>(*this) : mOutputVelocity;
+}
+
+Renderer::Texture& Velocity::Output(int parity)
+{
+    return Input(1 - parity);
+}
+
+int Velocity::GetParity() const
+{
+    return mParity;
+}
+
+void Velocity::Swap()
+{
+    mParity = 1 - mParity;
+}
+
+void Velocity::Resolve()
+{
+    if (mParity == 1)
+    {
+        mResolveCmd.Submit();
+        mParity = 0;
+    }
+}
+
 Renderer::Texture& Velocity::D()
 {
     return mDVelocity;
@@ -17,11 +17,40 @@ namespace Vortex2D { namespace Fluid {
 /**
  * @brief The Velocity field. Can be used to calculate a difference between different states.
  * Contains three fields: intput and output, used for ping-pong algorithms, and d, the difference between two velocity fields.
+ * Passes writing a new velocity field can swap the input and output instead of copying the output back,
+ * the current field is then given by the parity, see @ref Swap and @ref Resolve.
  */
 class Velocity : public Renderer::RenderTexture
 {
 public:
-    VORTEX2D_API Velocity(const Renderer::Device& device, const glm::ivec2& size);
+    /**
+     * @brief Storage precision of the velocity fields.
+     * Half precision halves the memory traffic of the kernels reading or writing the velocity,
+     * the computations themselves are still done in single precision.
+     */
+    enum class Precision
+    {
+        Full,
+        Half
+    };
+
+    VORTEX2D_API Velocity(const Renderer::Device& device,
+                          const glm::ivec2& size,
+                          Precision precision = Precision::Full);
+
+    /**
+     * @brief The storage precision of the velocity fields.
+     */
+    VORTEX2D_API Precision GetPrecision() const;
+
+    /**
+     * @brief Select the version of a kernel compiled for the precision of this velocity field.
+     * @param full kernel for the single precision velocity
+     * @param half kernel for the half precision velocity
+     * @return one of the two kernels
+     */
+    VORTEX2D_API const Renderer::SpirvBinary& SelectSpirv(const Renderer::SpirvBinary& full,
+                                                          const Renderer::SpirvBinary& half) const;
 
     /**
      * @brief An output texture used for algorithms that used the velocity as input and need to create a new velocity field
@@ -29,6 +58,36 @@ public:
      */
     VORTEX2D_API Renderer::Texture& Output();
 
+    /**
+     * @brief The field holding the current velocity for a parity: this texture for 0, the output texture for 1.
+     * @param parity the parity
+     * @return
+     */
+    VORTEX2D_API Renderer::Texture& Input(int parity);
+
+    /**
+     * @brief The field to write a new velocity to for a parity, i.e. the one of the opposite parity.
+     * @param parity the parity
+     * @return
+     */
+    VORTEX2D_API Renderer::Texture& Output(int parity);
+
+    /**
+     * @brief The parity of the field holding the current velocity.
+     * Only the passes recorded for both parities can be used when it is 1.
+     */
+    VORTEX2D_API int GetParity() const;
+
+    /**
+     * @brief Swap the input and output fields, after a pass wrote the new velocity in @ref Output(int).
+     */
+    VORTEX2D_API void Swap();
+
+    /**
+     * @brief Copy the current velocity back to this texture if the parity is 1, and reset the parity to 0.
+     */
+    VORTEX2D_API void Resolve();
+
     /**
      * @brief A difference velocity field, calculated with the difference between this velocity field, and the output velocity field
      * @return
@@ -58,6 +117,8 @@ public:
     VORTEX2D_API void VelocityDiff();
 
 private:
+    Precision mPrecision;
+    int mParity;
     Renderer::Texture mOutputVelocity;
     Renderer::Texture mDVelocity;
 
@@ -66,6 +127,7 @@ private:
 
     Renderer::CommandBuffer mSaveCopyCmd;
     Renderer::CommandBuffer mVelocityDiffCmd;
+    Renderer::CommandBuffer mResolveCmd;
 };
 
 }}
@@ -21,7 +21,12 @@ std::vector<RigidBody*> GetRigidbodyPointers(const std::vector<std::unique_ptr<R
     return rigidBodiesPointers;
 }
 
-World::World(const Renderer::Device& device, const glm::ivec2& size, float dt, int numSubSteps)
+World::World(const Renderer::Device& device,
+             const glm::ivec2& size,
+             float dt,
+             int numSubSteps,
+             Advection::Method advectionMethod,
+             Velocity::Precision precision)
     : mDevice(device)
     , mSize(size)
     , mDelta(dt / numSubSteps)
@@ -29,12 +34,12 @@ World::World(const Renderer::Device& device, const glm::ivec2& size, float dt, i
     , mPreconditioner(device, size, mDelta)
     , mLinearSolver(device, size, mPreconditioner)
     , mData(device, size)
-    , mVelocity(device, size)
+    , mVelocity(device, size, precision)
     , mLiquidPhi(device, size)
     , mStaticSolidPhi(device, size)
     , mDynamicSolidPhi(device, size)
     , mValid(device, size.x*size.y)
-    , mAdvection(device, size, mDelta, mVelocity)
+    , mAdvection(device, size, mDelta, mVelocity, advectionMethod)
     , mProjection(device, mDelta, size,
                   mData,
                   mVelocity,
@@ -43,9 +48,13 @@ World::World(const Renderer::Device& device, const glm::ivec2& size, float dt, i
                   mValid)
     , mExtrapolation(device, size, mValid, mVelocity)
     , mCopySolidPhi(device, false)
+    , mForces(device, size, dt, mVelocity)
+    , mProbes(device, mVelocity, mLiquidPhi, mDynamicSolidPhi)
     , mCfl(device, size, mVelocity)
+    , mTelemetry(device)
 {
     mExtrapolation.ConstrainBind(mDynamicSolidPhi);
+    mExtrapolation.LiquidPhiBind(mLiquidPhi);
     mLiquidPhi.ExtrapolateBind(mDynamicSolidPhi);
 
     mCopySolidPhi.Record([&](vk::CommandBuffer commandBuffer)
@@ -68,6 +77,15 @@ void World::Step()
   {
       Substep();
   }
+
+  if (mTelemetryCallback)
+  {
+      std::vector<float> residuals;
+      while (mTelemetry.Read(residuals))
+      {
+          mTelemetryCallback(residuals);
+      }
+  }
 }
 
 Renderer::RenderCommand World::RecordVelocity(Renderer::RenderTarget::DrawableList drawables)
@@ -90,6 +108,11 @@ void World::SubmitVelocity(Renderer::RenderCommand& renderCommand)
     mVelocities.push_back({renderCommand});
 }
 
+void World::AddForce(const Force& force)
+{
+    mForces.Add(force);
+}
+
 Renderer::RenderCommand World::RecordLiquidPhi(Renderer::RenderTarget::DrawableList drawables)
 {
     return mLiquidPhi.Record(drawables);
@@ -116,8 +139,7 @@ RigidBody* World::CreateRigidbody(vk::Flags<RigidBody::Type> type, float mass, f
 
     if (type & RigidBody::Type::eStatic)
     {
-        mRigidbodies.back()->BindDiv(mData.B, mData.Diagonal);
-        mRigidbodies.back()->BindVelocityConstrain(mVelocity);
+        mExtrapolation.RigidbodyBind(*mRigidbodies.back(), mData.B, mData.Diagonal);
         mLinearSolver.BindRigidbody(mData.Diagonal, *mRigidbodies.back());
     }
 
@@ -140,8 +162,54 @@ Renderer::Texture& World::GetVelocity()
     return mVelocity;
 }
 
-SmokeWorld::SmokeWorld(const Renderer::Device& device, const glm::ivec2& size, float dt)
-    : World(device, size, dt)
+void World::Sample(const std::vector<glm::vec2>& points)
+{
+    mProbes.Sample(points);
+}
+
+bool World::ReadSamples(std::vector<ProbeSample>& samples)
+{
+    return mProbes.Read(samples);
+}
+
+void World::SetSolverTelemetry(SolverTelemetryCallback callback)
+{
+    mTelemetryCallback = callback;
+    mLinearSolver.BindTelemetry(mTelemetryCallback ? &mTelemetry : nullptr);
+}
+
+void World::SetRedistanceMethod(LevelSet::RedistanceMethod method)
+{
+    mLiquidPhi.SetRedistanceMethod(method);
+    mStaticSolidPhi.SetRedistanceMethod(method);
+    mDynamicSolidPhi.SetRedistanceMethod(method);
+}
+
+void World::SetNarrowBand(float bandWidth)
+{
+    mLiquidPhi.SetNarrowBand(bandWidth);
+    mStaticSolidPhi.SetNarrowBand(bandWidth);
+    mDynamicSolidPhi.SetNarrowBand(bandWidth);
+}
+
+void World::SetRedistanceConvergence(float errorTolerance, int checkInterval)
+{
+    mLiquidPhi.SetConvergenceCheck(errorTolerance, checkInterval);
+    mStaticSolidPhi.SetConvergenceCheck(errorTolerance, checkInterval);
+    mDynamicSolidPhi.SetConvergenceCheck(errorTolerance, checkInterval);
+}
+
+void World::SetVelocityExtrapolation(Extrapolation::Method method, float bandWidth)
+{
+    mExtrapolation.SetMethod(method, bandWidth);
+}
+
+SmokeWorld::SmokeWorld(const Renderer::Device& device,
+                       const glm::ivec2& size,
+                       float dt,
+                       Advection::Method advectionMethod,
+                       Velocity::Precision precision)
+    : World(device, size, dt, 1, advectionMethod, precision)
 {
 }
 
@@ -152,6 +220,7 @@ void SmokeWorld::Substep()
         velocity.get().Submit();
     }
     mVelocities.clear();
+    mForces.Apply();
     
     mCopySolidPhi.Submit();
     for (auto&& rigidbody: mRigidbodies)
@@ -183,19 +252,12 @@ void SmokeWorld::Substep()
         }
     }
 
-    mExtrapolation.Extrapolate();
-    mExtrapolation.ConstrainVelocity();
-
-    for (auto&& rigidbody: mRigidbodies)
-    {
-        if (rigidbody->GetType() & RigidBody::Type::eStatic)
-        {
-            rigidbody->VelocityConstrain();
-        }
-    }
+    // The velocity is constrained to the output field, and advected back to the input field
+    mExtrapolation.ExtrapolateConstrain(true);
 
     mAdvection.AdvectVelocity();
     mAdvection.Advect();
+    mVelocity.Resolve();
 }
 
 void SmokeWorld::FieldBind(Density& density)
@@ -203,14 +265,28 @@ void SmokeWorld::FieldBind(Density& density)
     mAdvection.AdvectBind(density);
 }
 
-WaterWorld::WaterWorld(const Renderer::Device& device, const glm::ivec2& size, float dt)
-    : World(device, size, dt, 2)
-    , mParticles(device, vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eVertexBuffer, VMA_MEMORY_USAGE_GPU_ONLY, 8*size.x*size.y*sizeof(Particle))
-    , mParticleCount(device, size, mParticles, {0}, 0.02f)
+void SmokeWorld::FieldBind(Advection::FieldList fields)
 {
+    mAdvection.AdvectBind(fields);
+}
+
+WaterWorld::WaterWorld(const Renderer::Device& device,
+                       const glm::ivec2& size,
+                       float dt,
+                       bool apic,
+                       Velocity::Precision precision)
+    : World(device, size, dt, 2, Advection::Method::SemiLagrangian, precision)
+    , mParticles(std::make_unique<Particles>(device, 2*size.x*size.y, false, true, apic))
+    , mParticleCount(device, size, *mParticles, {0}, 0.02f)
+{
+    // Keep enough room to add a reasonable amount of water in one step
+    ParticleCapacityPolicy policy;
+    policy.MinCapacity = 2*size.x*size.y;
+    mParticleCount.SetCapacityPolicy(policy);
+
     mParticleCount.LevelSetBind(mLiquidPhi);
     mParticleCount.VelocitiesBind(mVelocity, mValid);
-    mAdvection.AdvectParticleBind(mParticles, mDynamicSolidPhi, mParticleCount.GetDispatchParams());
+    mAdvection.AdvectParticleBind(mParticleCount, mDynamicSolidPhi);
 }
 
 void WaterWorld::Substep()
@@ -225,6 +301,14 @@ void WaterWorld::Substep()
      7) Advect particles
      */
 
+    if (mParticleCount.UpdateCapacity())
+    {
+        // The particle count now owns the particle buffers. The initial buffers can still be in use
+        // until the reallocation completes, which the next reallocation waits for
+        mRetiredParticles = std::move(mParticles);
+        mAdvection.AdvectParticleBind(mParticleCount, mDynamicSolidPhi);
+    }
+
     // 1)
     mParticleCount.Scan();
     mParticleCount.Phi();
@@ -240,6 +324,7 @@ void WaterWorld::Substep()
         velocity.get().Submit();
     }
     mVelocities.clear();
+    mForces.Apply();
 
     // 4)
     mCopySolidPhi.Submit();
@@ -274,16 +359,7 @@ void WaterWorld::Substep()
         }
     }
 
-    mExtrapolation.Extrapolate();
-    mExtrapolation.ConstrainVelocity();
-
-    for (auto&& rigidbody: mRigidbodies)
-    {
-        if (rigidbody->GetType() & RigidBody::Type::eStatic)
-        {
-            rigidbody->VelocityConstrain();
-        }
-    }
+    mExtrapolation.ExtrapolateConstrain();
 
     // 6)
     mVelocity.VelocityDiff();
@@ -291,6 +367,7 @@ void WaterWorld::Substep()
 
     // 7)
     mAdvection.AdvectParticles();
+    mVelocity.Resolve();
 }
 
 Renderer::RenderCommand WaterWorld::RecordParticleCount(Renderer::RenderTarget::DrawableList drawables)
@@ -298,4 +375,14 @@ Renderer::RenderCommand WaterWorld::RecordParticleCount(Renderer::RenderTarget::
     return mParticleCount.Record(drawables);
 }
 
+void WaterWorld::SetParticleEmitters(const std::vector<ParticleEmitter>& emitters)
+{
+    mParticleCount.SetEmitters(emitters);
+}
+
+ParticleCount& WaterWorld::GetParticleCount()
+{
+    return mParticleCount;
+}
+
 }}
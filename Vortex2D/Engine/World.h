@@ -13,12 +13,15 @@
 #include <Vortex2D/Engine/LinearSolver/LinearSolver.h>
 #include <Vortex2D/Engine/LinearSolver/ConjugateGradient.h>
 #include <Vortex2D/Engine/LinearSolver/Multigrid.h>
+#include <Vortex2D/Engine/LinearSolver/Telemetry.h>
 #include <Vortex2D/Engine/Extrapolation.h>
 #include <Vortex2D/Engine/LevelSet.h>
 #include <Vortex2D/Engine/Pressure.h>
 #include <Vortex2D/Engine/Advection.h>
 #include <Vortex2D/Engine/Particles.h>
 #include <Vortex2D/Engine/Velocity.h>
+#include <Vortex2D/Engine/Forces.h>
+#include <Vortex2D/Engine/Probes.h>
 #include <Vortex2D/Engine/Rigidbody.h>
 #include <Vortex2D/Engine/Boundaries.h>
 #include <Vortex2D/Engine/Density.h>
@@ -38,14 +41,23 @@ namespace Vortex2D { namespace Fluid {
 class World
 {
 public:
+    using SolverTelemetryCallback = std::function<void(const std::vector<float>&)>;
+
     /**
      * @brief Construct an Engine with a size and time step.
      * @param device vulkan device
      * @param size dimensions of the simulation
      * @param dt timestamp of the simulation, e.g. 0.016 for 60FPS simulations.
      * @param numSubSteps the number of sub-steps to perform per step call. Reduces loss of fluid.
+     * @param advectionMethod advection scheme of the velocity and fields.
+     * @param precision storage precision of the velocity, the pressure solve is always in single precision.
      */
-    World(const Renderer::Device& device, const glm::ivec2& size, float dt, int numSubSteps = 1);
+    World(const Renderer::Device& device,
+          const glm::ivec2& size,
+          float dt,
+          int numSubSteps = 1,
+          Advection::Method advectionMethod = Advection::Method::SemiLagrangian,
+          Velocity::Precision precision = Velocity::Precision::Full);
     virtual ~World() = default;
 
     /**
@@ -66,6 +78,13 @@ public:
      */
     VORTEX2D_API void SubmitVelocity(Renderer::RenderCommand& renderCommand);
 
+    /**
+     * @brief Add a force to the velocity field. All the forces added before a step are applied
+     * together in a single dispatch at the start of the step, without any render pass.
+     * @param force the force, see @ref Forces::MaxForces for the maximum per step
+     */
+    VORTEX2D_API void AddForce(const Force& force);
+
     /**
      * @brief Record drawables to the liquid level set, i.e. to define the fluid area.
      * The drawables need to make a signed distance field, if not the result is undefined.
@@ -115,6 +134,54 @@ public:
      */
     VORTEX2D_API Renderer::Texture& GetVelocity();
 
+    /**
+     * @brief Sample the velocity, liquid and solid level sets at a list of points, e.g. to couple objects to the fluid.
+     * The fields are sampled on the GPU without reading them back, see @ref ReadSamples to get the result.
+     * @param points positions in cells, at most 4096.
+     */
+    VORTEX2D_API void Sample(const std::vector<glm::vec2>& points);
+
+    /**
+     * @brief Read the samples of the oldest call to @ref Sample, if they are ready. Non-blocking.
+     * @param samples the samples, in the same order as the points.
+     * @return true if samples were read.
+     */
+    VORTEX2D_API bool ReadSamples(std::vector<ProbeSample>& samples);
+
+    /**
+     * @brief Set a callback receiving the residual of each iteration of the pressure solve.
+     * The residuals are recorded on the GPU and read back asynchronously, so the callback is
+     * called during @ref Step with the residuals of solves from previous steps.
+     * @param callback function called once per solve, the first residual is the initial one. Empty to disable.
+     */
+    VORTEX2D_API void SetSolverTelemetry(SolverTelemetryCallback callback);
+
+    /**
+     * @brief Select the algorithm used to reinitialise the level sets of the simulation.
+     * @param method iterative (default) or jump flooding
+     */
+    VORTEX2D_API void SetRedistanceMethod(LevelSet::RedistanceMethod method);
+
+    /**
+     * @brief Restrict the reinitialisation of the level sets to a narrow band, see @ref LevelSet::SetNarrowBand.
+     * @param bandWidth the width of the band in cells, or 0 to disable
+     */
+    VORTEX2D_API void SetNarrowBand(float bandWidth);
+
+    /**
+     * @brief Stop the reinitialisation of the level sets early once converged, see @ref LevelSet::SetConvergenceCheck.
+     * @param errorTolerance the maximum error to stop, or 0 to disable
+     * @param checkInterval the number of iterations between checks
+     */
+    VORTEX2D_API void SetRedistanceConvergence(float errorTolerance, int checkInterval = 10);
+
+    /**
+     * @brief Set how the velocity is extrapolated out of the liquid, see @ref Extrapolation::SetMethod.
+     * @param method the extrapolation method
+     * @param bandWidth width in cells of the band extrapolated with the closest point method
+     */
+    VORTEX2D_API void SetVelocityExtrapolation(Extrapolation::Method method, float bandWidth = 10.0f);
+
 protected:
     virtual void Substep() = 0;
 
@@ -142,8 +209,13 @@ protected:
 
     std::vector<std::unique_ptr<RigidBody>> mRigidbodies;
     std::vector<std::reference_wrapper<Renderer::RenderCommand>> mVelocities;
+    Forces mForces;
+    Probes mProbes;
 
     Cfl mCfl;
+
+    Telemetry mTelemetry;
+    SolverTelemetryCallback mTelemetryCallback;
 };
 
 /**
@@ -153,7 +225,20 @@ protected:
 class SmokeWorld : public World
 {
 public:
-    VORTEX2D_API SmokeWorld(const Renderer::Device& device, const glm::ivec2& size, float dt);
+    /**
+     * @brief Construct a smoke simulation.
+     * @param device vulkan device
+     * @param size dimensions of the simulation
+     * @param dt timestep of the simulation
+     * @param advectionMethod advection scheme of the velocity and density fields.
+     * MacCormack or BFECC keep more details than semi-Lagrangian at the same resolution.
+     * @param precision storage precision of the velocity, see @ref Velocity::Precision.
+     */
+    VORTEX2D_API SmokeWorld(const Renderer::Device& device,
+                            const glm::ivec2& size,
+                            float dt,
+                            Advection::Method advectionMethod = Advection::Method::SemiLagrangian,
+                            Velocity::Precision precision = Velocity::Precision::Full);
 
     /**
      * @brief Bind a density field to be moved around with the fluid
@@ -161,6 +246,13 @@ public:
      */
     VORTEX2D_API void FieldBind(Density& density);
 
+    /**
+     * @brief Bind several fields to be moved around with the fluid, e.g. dye, temperature and fuel.
+     * See @ref Advection::AdvectBind for the supported formats.
+     * @param fields the fields
+     */
+    VORTEX2D_API void FieldBind(Advection::FieldList fields);
+
 private:
     void Substep() override;
 };
@@ -171,7 +263,22 @@ private:
 class WaterWorld : public World
 {
 public:
-    VORTEX2D_API WaterWorld(const Renderer::Device& device, const glm::ivec2& size, float dt);
+    /**
+     * @brief Construct a water simulation.
+     * The particle capacity starts at 2 particles per cell and then follows the number of particles,
+     * see @ref ParticleCount::UpdateCapacity.
+     * The particles are stored in the compact format, see @ref Particles.
+     * @param device vulkan device
+     * @param size dimensions of the simulation
+     * @param dt timestep of the simulation
+     * @param apic use APIC particle transfers instead of PIC/FLIP
+     * @param precision storage precision of the velocity, see @ref Velocity::Precision.
+     */
+    VORTEX2D_API WaterWorld(const Renderer::Device& device,
+                            const glm::ivec2& size,
+                            float dt,
+                            bool apic = false,
+                            Velocity::Precision precision = Velocity::Precision::Full);
 
     /**
      * @brief The water simulation uses particles to define the water area.
@@ -183,10 +290,23 @@ public:
      */
     VORTEX2D_API Renderer::RenderCommand RecordParticleCount(Renderer::RenderTarget::DrawableList drawables);
 
+    /**
+     * @brief Add or remove particles with emitters and sinks, applied at the next step.
+     * Unlike @ref RecordParticleCount, this doesn't use a render pass.
+     * @param emitters list of emitters, see @ref ParticleCount::SetEmitters
+     */
+    VORTEX2D_API void SetParticleEmitters(const std::vector<ParticleEmitter>& emitters);
+
+    /**
+     * @brief Get the particles of the simulation, e.g. to draw them with a @ref ParticleSprite.
+     * @return the particle count
+     */
+    VORTEX2D_API ParticleCount& GetParticleCount();
+
 private:
     void Substep() override;
 
-    Renderer::GenericBuffer mParticles;
+    std::unique_ptr<Particles> mParticles, mRetiredParticles;
     ParticleCount mParticleCount;
 };
 
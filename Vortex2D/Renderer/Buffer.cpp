@@ -100,12 +100,28 @@ void GenericBuffer::CopyFrom(vk::CommandBuffer commandBuffer, GenericBuffer& src
         throw std::runtime_error("Cannot copy buffers of different sizes");
     }
 
+    CopyFrom(commandBuffer, srcBuffer, mSize);
+}
+
+void GenericBuffer::CopyFrom(vk::CommandBuffer commandBuffer, GenericBuffer& srcBuffer, vk::DeviceSize size)
+{
+    CopyFrom(commandBuffer, srcBuffer, 0, size);
+}
+
+void GenericBuffer::CopyFrom(vk::CommandBuffer commandBuffer, GenericBuffer& srcBuffer, vk::DeviceSize srcOffset, vk::DeviceSize size)
+{
+    if (size > mSize || srcOffset + size > srcBuffer.mSize)
+    {
+        throw std::runtime_error("Cannot copy more than the size of the buffers");
+    }
+
     // TODO improve barriers
     srcBuffer.Barrier(commandBuffer, vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eTransferRead);
     Barrier(commandBuffer, vk::AccessFlagBits::eShaderRead, vk::AccessFlagBits::eTransferWrite);
 
     auto region = vk::BufferCopy()
-            .setSize(mSize);
+            .setSrcOffset(srcOffset)
+            .setSize(size);
 
     commandBuffer.copyBuffer(srcBuffer.Handle(), mBuffer, region);
 
@@ -115,7 +131,22 @@ void GenericBuffer::CopyFrom(vk::CommandBuffer commandBuffer, GenericBuffer& src
 
 void GenericBuffer::CopyFrom(vk::CommandBuffer commandBuffer, Texture& srcTexture)
 {
-    // TODO check if it can be copied
+    CopyFrom(commandBuffer, srcTexture, glm::ivec2(0), glm::ivec2(srcTexture.GetWidth(), srcTexture.GetHeight()));
+}
+
+void GenericBuffer::CopyFrom(vk::CommandBuffer commandBuffer, Texture& srcTexture, const glm::ivec2& offset, const glm::ivec2& size)
+{
+    if (size.x <= 0 || size.y <= 0 || offset.x < 0 || offset.y < 0 ||
+        offset.x + size.x > static_cast<int>(srcTexture.GetWidth()) ||
+        offset.y + size.y > static_cast<int>(srcTexture.GetHeight()))
+    {
+        throw std::runtime_error("Cannot copy outside of the texture");
+    }
+
+    if (GetBytesPerPixel(srcTexture.GetFormat()) * size.x * size.y > mSize)
+    {
+        throw std::runtime_error("Cannot copy more than the size of the buffer");
+    }
 
     srcTexture.Barrier(commandBuffer,
                        vk::ImageLayout::eGeneral,
@@ -125,7 +156,8 @@ void GenericBuffer::CopyFrom(vk::CommandBuffer commandBuffer, Texture& srcTextur
 
     auto info = vk::BufferImageCopy()
             .setImageSubresource({vk::ImageAspectFlagBits::eColor, 0, 0 ,1})
-            .setImageExtent({srcTexture.GetWidth(), srcTexture.GetHeight(), 1});
+            .setImageOffset({offset.x, offset.y, 0})
+            .setImageExtent({static_cast<uint32_t>(size.x), static_cast<uint32_t>(size.y), 1});
 
     commandBuffer.copyImageToBuffer(srcTexture.mImage,
                                     vk::ImageLayout::eTransferSrcOptimal,
@@ -181,6 +213,13 @@ void GenericBuffer::CopyFrom(const void* data)
 
 void GenericBuffer::CopyTo(void* data)
 {
+    CopyTo(data, mSize);
+}
+
+void GenericBuffer::CopyTo(void* data, vk::DeviceSize size)
+{
+  if (size > mSize) throw std::runtime_error("Cannot copy more than the size of the buffer");
+
   // TODO use always mapped functionality of VMA
 
   VkMemoryPropertyFlags memFlags;
@@ -200,7 +239,7 @@ void GenericBuffer::CopyTo(void* data)
       mDevice.Handle().invalidateMappedMemoryRanges(memRange);
   }
 
-  std::memcpy(data, pData, mSize);
+  std::memcpy(data, pData, size);
 
   vmaUnmapMemory(mDevice.Allocator(), mAllocation);
 }
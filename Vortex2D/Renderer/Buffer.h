@@ -36,6 +36,23 @@ public:
      */
     VORTEX2D_API void CopyFrom(vk::CommandBuffer commandBuffer, GenericBuffer& srcBuffer);
 
+    /**
+     * @brief Copy the start of a buffer to the start of this buffer
+     * @param commandBuffer command buffer to run the copy on.
+     * @param srcBuffer the source buffer.
+     * @param size the number of bytes to copy, must fit in both buffers.
+     */
+    VORTEX2D_API void CopyFrom(vk::CommandBuffer commandBuffer, GenericBuffer& srcBuffer, vk::DeviceSize size);
+
+    /**
+     * @brief Copy a range of a buffer to the start of this buffer
+     * @param commandBuffer command buffer to run the copy on.
+     * @param srcBuffer the source buffer.
+     * @param srcOffset the offset in bytes of the range in the source buffer.
+     * @param size the number of bytes to copy, must fit in both buffers.
+     */
+    VORTEX2D_API void CopyFrom(vk::CommandBuffer commandBuffer, GenericBuffer& srcBuffer, vk::DeviceSize srcOffset, vk::DeviceSize size);
+
     /**
      * @brief Copy a texture to this buffer
      * @param commandBuffer command buffer to run the copy on.
@@ -43,6 +60,15 @@ public:
      */
     VORTEX2D_API void CopyFrom(vk::CommandBuffer commandBuffer, Texture& srcTexture);
 
+    /**
+     * @brief Copy a rectangle of a texture to the start of this buffer, with the rows tightly packed.
+     * @param commandBuffer command buffer to run the copy on.
+     * @param srcTexture the source texture
+     * @param offset the top left corner of the rectangle
+     * @param size the size of the rectangle, must fit in the texture.
+     */
+    VORTEX2D_API void CopyFrom(vk::CommandBuffer commandBuffer, Texture& srcTexture, const glm::ivec2& offset, const glm::ivec2& size);
+
     /**
      * @brief The vulkan handle
      */
@@ -78,9 +104,12 @@ public:
     template<template<typename> class BufferType, typename T>
     friend void CopyFrom(BufferType<T>&, const std::vector<T>&);
 
+    friend class Readback;
+
 protected:
     VORTEX2D_API void CopyFrom(const void* data);
     VORTEX2D_API void CopyTo(void* data);
+    VORTEX2D_API void CopyTo(void* data, vk::DeviceSize size);
 
     const Device& mDevice;
     vk::DeviceSize mSize;
@@ -106,6 +106,16 @@ void CommandBuffer::Wait()
     }
 }
 
+bool CommandBuffer::IsFinished()
+{
+    if (mSynchronise)
+    {
+        return mDevice.Handle().getFenceStatus(*mFence) == vk::Result::eSuccess;
+    }
+
+    return true;
+}
+
 void CommandBuffer::Reset()
 {
     if (mSynchronise)
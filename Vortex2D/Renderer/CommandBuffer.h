@@ -55,6 +55,12 @@ public:
      */
     VORTEX2D_API void Wait();
 
+    /**
+     * @brief Check if the command submit has finished, without waiting. Always true if the synchronise flag was false.
+     * @return true if the commands have completed.
+     */
+    VORTEX2D_API bool IsFinished();
+
     /**
      * @brief Reset the command buffer so it can be recorded again.
      */
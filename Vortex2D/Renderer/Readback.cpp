@@ -0,0 +1,96 @@
+//
+//  Readback.cpp
+//  Vortex2D
+//
+
+#include "Readback.h"
+
+namespace Vortex2D { namespace Renderer {
+
+Readback::Readback(const Device& device, vk::DeviceSize capacity, unsigned ringSize)
+    : mCapacity(capacity)
+    , mSizes(ringSize, 0)
+    , mWriteIndex(0)
+    , mReadIndex(0)
+    , mPending(0)
+{
+    for (unsigned i = 0; i < ringSize; i++)
+    {
+        mLocalBuffers.emplace_back(device, vk::BufferUsageFlagBits::eStorageBuffer, VMA_MEMORY_USAGE_GPU_TO_CPU, capacity);
+        mCopyCmds.emplace_back(device, true);
+    }
+}
+
+void Readback::CopyFrom(Texture& texture, const glm::ivec2& offset, const glm::ivec2& size)
+{
+    if (size.x <= 0 || size.y <= 0)
+    {
+        throw std::runtime_error("Cannot copy an empty rectangle");
+    }
+
+    vk::DeviceSize bytes = GetBytesPerPixel(texture.GetFormat()) * size.x * size.y;
+    if (bytes > mCapacity)
+    {
+        throw std::runtime_error("Readback capacity too small");
+    }
+
+    Submit(bytes, [&](vk::CommandBuffer commandBuffer)
+    {
+        mLocalBuffers[mWriteIndex].CopyFrom(commandBuffer, texture, offset, size);
+    });
+}
+
+void Readback::CopyFrom(GenericBuffer& buffer, vk::DeviceSize offset, vk::DeviceSize size)
+{
+    if (size > mCapacity)
+    {
+        throw std::runtime_error("Readback capacity too small");
+    }
+
+    Submit(size, [&](vk::CommandBuffer commandBuffer)
+    {
+        mLocalBuffers[mWriteIndex].CopyFrom(commandBuffer, buffer, offset, size);
+    });
+}
+
+void Readback::Submit(vk::DeviceSize size, CommandBuffer::CommandFn commandFn)
+{
+    // Record waits on the previous copy of this slot, which only blocks if the ring is full
+    mCopyCmds[mWriteIndex].Record([&](vk::CommandBuffer commandBuffer)
+    {
+        commandFn(commandBuffer);
+        mLocalBuffers[mWriteIndex].Barrier(commandBuffer, vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eHostRead);
+    });
+    mCopyCmds[mWriteIndex].Submit();
+    mSizes[mWriteIndex] = size;
+    mWriteIndex = (mWriteIndex + 1) % mCopyCmds.size();
+
+    if (mPending == mCopyCmds.size())
+    {
+        mReadIndex = (mReadIndex + 1) % mCopyCmds.size();
+    }
+    else
+    {
+        mPending++;
+    }
+}
+
+bool Readback::IsReady()
+{
+    return mPending != 0 && mCopyCmds[mReadIndex].IsFinished();
+}
+
+vk::DeviceSize Readback::ReadySize() const
+{
+    return mSizes[mReadIndex];
+}
+
+void Readback::Read(void* data)
+{
+    mLocalBuffers[mReadIndex].CopyTo(data, mSizes[mReadIndex]);
+
+    mReadIndex = (mReadIndex + 1) % mCopyCmds.size();
+    mPending--;
+}
+
+}}
@@ -0,0 +1,91 @@
+//
+//  Readback.h
+//  Vortex2D
+//
+
+#ifndef Vortex2D_Readback_h
+#define Vortex2D_Readback_h
+
+#include <Vortex2D/Renderer/Common.h>
+#include <Vortex2D/Renderer/Buffer.h>
+#include <Vortex2D/Renderer/Texture.h>
+#include <Vortex2D/Renderer/CommandBuffer.h>
+
+#include <vector>
+
+namespace Vortex2D { namespace Renderer {
+
+/**
+ * @brief Reads back a part of a texture or buffer, e.g. an inspection window or a single row of a field.
+ * The part is copied to a small ring of host buffers and can be read later without stalling.
+ */
+class Readback
+{
+public:
+    /**
+     * @brief Initialize the readback with a capacity and ring size.
+     * @param device vulkan device
+     * @param capacity maximum number of bytes read at once
+     * @param ringSize number of copies that can be pending a read
+     */
+    VORTEX2D_API Readback(const Device& device, vk::DeviceSize capacity, unsigned ringSize = 3);
+
+    /**
+     * @brief Copy a rectangle of a texture to the next host buffer of the ring. Non-blocking.
+     * If all the host buffers are pending a read, the oldest one is overwritten.
+     * The number of bytes per texel is given by the format of the texture.
+     * @param texture the texture to read
+     * @param offset the top left corner of the rectangle
+     * @param size the size of the rectangle
+     */
+    VORTEX2D_API void CopyFrom(Texture& texture, const glm::ivec2& offset, const glm::ivec2& size);
+
+    /**
+     * @brief Copy a range of a buffer to the next host buffer of the ring. Non-blocking.
+     * If all the host buffers are pending a read, the oldest one is overwritten.
+     * @param buffer the buffer to read
+     * @param offset the offset in bytes of the range
+     * @param size the number of bytes of the range
+     */
+    VORTEX2D_API void CopyFrom(GenericBuffer& buffer, vk::DeviceSize offset, vk::DeviceSize size);
+
+    /**
+     * @brief Read the oldest copy, if it has completed. Non-blocking.
+     * @param data the texels, row by row, or the elements of the buffer range.
+     * @return true if data was read.
+     */
+    template<typename T>
+    bool Read(std::vector<T>& data)
+    {
+        if (!IsReady())
+        {
+            return false;
+        }
+
+        if (ReadySize() % sizeof(T) != 0)
+        {
+            throw std::runtime_error("Read type does not match the copied data");
+        }
+
+        data.resize(ReadySize() / sizeof(T));
+        Read(data.data());
+        return true;
+    }
+
+private:
+    VORTEX2D_API bool IsReady();
+    VORTEX2D_API vk::DeviceSize ReadySize() const;
+    VORTEX2D_API void Read(void* data);
+
+    void Submit(vk::DeviceSize size, CommandBuffer::CommandFn commandFn);
+
+    vk::DeviceSize mCapacity;
+    std::vector<GenericBuffer> mLocalBuffers;
+    std::vector<CommandBuffer> mCopyCmds;
+    std::vector<vk::DeviceSize> mSizes;
+    unsigned mWriteIndex, mReadIndex, mPending;
+};
+
+}}
+
+#endif
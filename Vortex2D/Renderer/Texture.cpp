@@ -37,6 +37,33 @@ vk::UniqueSampler SamplerBuilder::Create(vk::Device device)
     return device.createSamplerUnique(mSamplerInfo);
 }
 
+vk::DeviceSize GetBytesPerPixel(vk::Format format)
+{
+    switch (format)
+    {
+    case vk::Format::eR8Uint:
+        return 1;
+    case vk::Format::eR8G8B8A8Unorm:
+    case vk::Format::eB8G8R8A8Unorm:
+    case vk::Format::eR16G16Sfloat:
+    case vk::Format::eR32Sfloat:
+    case vk::Format::eR32Sint:
+        return 4;
+    case vk::Format::eR32G32Sfloat:
+        return 8;
+    case vk::Format::eR32G32B32A32Sfloat:
+        return 16;
+    default:
+        throw std::runtime_error("Unsupported texture format");
+    }
+}
+
+bool IsLinearFilterSupported(const Device& device, vk::Format format)
+{
+    auto properties = device.GetPhysicalDevice().getFormatProperties(format);
+    return static_cast<bool>(properties.optimalTilingFeatures & vk::FormatFeatureFlagBits::eSampledImageFilterLinear);
+}
+
 Texture::Texture(const Device& device, uint32_t width, uint32_t height, vk::Format format, VmaMemoryUsage memoryUsage)
     : mDevice(device)
     , mWidth(width)
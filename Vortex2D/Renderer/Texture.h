@@ -46,6 +46,21 @@ private:
     vk::SamplerCreateInfo mSamplerInfo;
 };
 
+/**
+ * @brief Number of bytes of a pixel of the given format.
+ * Throws if the format is not one used by Vortex2D.
+ */
+VORTEX2D_API vk::DeviceSize GetBytesPerPixel(vk::Format format);
+
+/**
+ * @brief Checks if textures of the given format can be sampled with linear filtering.
+ * Vulkan doesn't guarantee it for all formats, e.g. 32 bits floats.
+ * @param device vulkan device
+ * @param format format of the texture
+ * @return true if a sampler with a linear filter can be used
+ */
+VORTEX2D_API bool IsLinearFilterSupported(const Device& device, vk::Format format);
+
 /**
  * @brief A texture, or in vulkan terms, an image.
  */
@@ -55,11 +55,10 @@ ComputeSize ComputeSize::Default1D()
     return ComputeSize(1);
 }
 
-ComputeSize MakeStencilComputeSize(const glm::ivec2& size, int radius)
+ComputeSize MakeStencilComputeSize(const glm::ivec2& size, int radius, const glm::ivec2& localSize)
 {
     ComputeSize computeSize(ComputeSize::Default2D());
 
-    auto localSize = ComputeSize::GetLocalSize2D();
     computeSize.DomainSize = size;
     computeSize.LocalSize = localSize;
     computeSize.WorkSize = glm::ceil(glm::vec2(size) / glm::vec2(localSize - glm::ivec2(2 * radius)));
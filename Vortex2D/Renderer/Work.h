@@ -83,9 +83,12 @@ struct ComputeSize
  * @brief Create a ComputeSize for a stencil type shader
  * @param size the domain size
  * @param radius the stencil size
+ * @param localSize the local size, including the stencil border
  * @return calculate ComputeSize
  */
-VORTEX2D_API ComputeSize MakeStencilComputeSize(const glm::ivec2& size, int radius);
+VORTEX2D_API ComputeSize MakeStencilComputeSize(const glm::ivec2& size,
+                                                int radius,
+                                                const glm::ivec2& localSize = ComputeSize::GetLocalSize2D());
 
 /**
  * @brief Create a ComputeSize for a checkerboard type shader
@@ -22,8 +22,9 @@ endfunction()
 set(vortex2d_macro__internal_dir ${CMAKE_CURRENT_LIST_DIR} CACHE INTERNAL "")
 
 # Function to compile the shaders and generate a C++ source file to include
+# The VARIANT_SOURCES are compiled a second time with the VARIANT_DEFINES, with the VARIANT name appended
 function(compile_shader)
-    cmake_parse_arguments(SHADER "" "OUTPUT;VERSION" "SOURCES" ${ARGN})
+    cmake_parse_arguments(SHADER "" "OUTPUT;VERSION;VARIANT" "SOURCES;VARIANT_SOURCES;VARIANT_DEFINES" ${ARGN})
 
     if (NOT DEFINED GLSL_VALIDATOR)
       vortex2d_find_program(GLSL_VALIDATOR glslangValidator hints "$ENV{VULKAN_SDK}/Bin")
@@ -32,10 +33,19 @@ function(compile_shader)
     endif()
     message("Using compiler: ${GLSL_VALIDATOR}")
 
+    set(VARIANT_ARGS "")
+    if (SHADER_VARIANT_SOURCES)
+      list(APPEND VARIANT_ARGS --variant_name ${SHADER_VARIANT})
+      foreach(DEFINE ${SHADER_VARIANT_DEFINES})
+        list(APPEND VARIANT_ARGS --variant_define ${DEFINE})
+      endforeach()
+      list(APPEND VARIANT_ARGS --variant_files ${SHADER_VARIANT_SOURCES})
+    endif()
+
     set(COMPILE_SCRIPT ${vortex2d_macro__internal_dir}/../Scripts/GenerateSPIRV.py)
     add_custom_command(
        OUTPUT "${SHADER_OUTPUT}.h" "${SHADER_OUTPUT}.cpp"
-       COMMAND ${PYTHON_EXECUTABLE} ${COMPILE_SCRIPT} --compiler ${GLSL_VALIDATOR} --vulkan_version ${SHADER_VERSION} --output ${SHADER_OUTPUT} ${SHADER_SOURCES}
+       COMMAND ${PYTHON_EXECUTABLE} ${COMPILE_SCRIPT} --compiler ${GLSL_VALIDATOR} --vulkan_version ${SHADER_VERSION} --output ${SHADER_OUTPUT} ${SHADER_SOURCES} ${VARIANT_ARGS}
        DEPENDS ${SHADER_SOURCES} ${COMPILE_SCRIPT})
 endfunction()
 